@@ -0,0 +1,88 @@
+#include "pch.h"
+#include "catalog.h"
+
+namespace fourdb
+{
+    catalog::catalog()
+        : m_snapshot(std::make_shared<snapshot>())
+    {
+    }
+
+    void catalog::load(db& db)
+    {
+        auto next = std::make_shared<snapshot>();
+
+        std::wstring sql =
+            L"SELECT t.id, t.name, t.isNumeric, n.id, n.name, n.isNumeric "
+            L"FROM tables t LEFT OUTER JOIN names n ON n.tableid = t.id";
+        auto reader = db.execReader(sql);
+        while (reader->read())
+        {
+            int tableId = reader->getInt32(0);
+            if (next->tables.find(tableId) == next->tables.end())
+            {
+                tables::table_obj table;
+                table.id = tableId;
+                table.name = reader->getString(1);
+                table.isNumeric = reader->getBoolean(2);
+                next->tableIds[table.name] = tableId;
+                next->tables[tableId] = table;
+            }
+
+            if (reader->isNull(3))
+                continue;
+
+            names::name_obj name;
+            name.id = reader->getInt32(3);
+            name.tableId = tableId;
+            name.name = reader->getString(4);
+            name.isNumeric = reader->getBoolean(5);
+            next->nameIds[tableId][name.name] = name.id;
+            next->names[name.id] = name;
+        }
+        reader.reset();
+
+        reader = db.execReader(L"SELECT tableid, nameid FROM searchcolumns");
+        while (reader->read())
+            next->searchNameIds[reader->getInt32(0)].insert(reader->getInt32(1));
+        reader.reset();
+
+        reader = db.execReader(L"SELECT tableid, nameid FROM indexcolumns");
+        while (reader->read())
+            next->indexNameIds[reader->getInt32(0)].insert(reader->getInt32(1));
+        reader.reset();
+
+        std::lock_guard<std::mutex> lock(m_changeMutex);
+        publish(next);
+    }
+
+    void catalog::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_changeMutex);
+        publish(std::make_shared<snapshot>());
+    }
+
+    void catalog::addTable(const tables::table_obj& table)
+    {
+        std::lock_guard<std::mutex> lock(m_changeMutex);
+        auto next = std::make_shared<snapshot>(*current());
+        next->tableIds[table.name] = table.id;
+        next->tables[table.id] = table;
+        publish(next);
+    }
+
+    void catalog::addName(const names::name_obj& name)
+    {
+        std::lock_guard<std::mutex> lock(m_changeMutex);
+        auto next = std::make_shared<snapshot>(*current());
+        next->nameIds[name.tableId][name.name] = name.id;
+        next->names[name.id] = name;
+        publish(next);
+    }
+
+    void catalog::publish(std::shared_ptr<snapshot> next)
+    {
+        next->version = current()->version + 1;
+        m_snapshot.store(next);
+    }
+}
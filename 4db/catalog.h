@@ -0,0 +1,61 @@
+#pragma once
+
+#include "db.h"
+#include "names.h"
+#include "tables.h"
+
+namespace fourdb
+{
+    /// <summary>
+    /// The virtual schema, tables and their columns, cached for one database
+    /// Readers get an immutable snapshot without taking any locks
+    /// Changes copy the current snapshot, make the change, and publish the copy
+    /// </summary>
+    class catalog
+    {
+    public:
+        struct snapshot
+        {
+            int64_t version = 0; // goes up with every change
+
+            std::unordered_map<std::wstring, int> tableIds; // table name => table ID
+            std::unordered_map<int, fourdb::tables::table_obj> tables; // table ID => table
+
+            std::unordered_map<int, std::unordered_map<std::wstring, int>> nameIds; // table ID => column name => name ID
+            std::unordered_map<int, fourdb::names::name_obj> names; // name ID => name
+
+            std::unordered_map<int, std::unordered_set<int>> searchNameIds; // table ID => searchable name IDs, 0 for the row key
+            std::unordered_map<int, std::unordered_set<int>> indexNameIds; // table ID => indexed name IDs
+        };
+
+        catalog();
+
+        /// <summary>
+        /// Load the whole schema, replacing whatever is cached
+        /// </summary>
+        void load(db& db);
+
+        /// <summary>
+        /// Drop everything that is cached
+        /// </summary>
+        void clear();
+
+        /// <summary>
+        /// Get the current snapshot, good for as long as you hold onto it
+        /// </summary>
+        std::shared_ptr<const snapshot> current() const
+        {
+            return m_snapshot.load();
+        }
+
+        void addTable(const tables::table_obj& table);
+        void addName(const names::name_obj& name);
+
+    private:
+        void publish(std::shared_ptr<snapshot> next);
+
+    private:
+        std::mutex m_changeMutex; // changes are serialized, reads are not
+        std::atomic<std::shared_ptr<const snapshot>> m_snapshot;
+    };
+}
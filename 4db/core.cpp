@@ -17,9 +17,186 @@ std::string fourdb::fourdberr::getExceptionMsg(int rc, sqlite3* db)
 
 std::wstring fourdb::num2str(double num)
 {
-    std::wstringstream ss;
-    ss << num;
-    return ss.str();
+    // Whole numbers are row IDs and such, keep them out of scientific notation
+    char buffer[32];
+    std::to_chars_result result;
+    if (std::abs(num) < 1e18 && num == std::trunc(num))
+        result = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<int64_t>(num));
+    else
+        result = std::to_chars(buffer, buffer + sizeof(buffer), num);
+    if (result.ec != std::errc())
+        throw fourdberr("num2str fails");
+    return std::wstring(buffer, result.ptr);
+}
+
+namespace
+{
+    const wchar_t REPLACEMENT_CHAR = 0xFFFD;
+
+    // 8 bytes at a time, bail at the first one with its high bit set
+    size_t countAscii(const char* str, size_t len)
+    {
+        size_t idx = 0;
+        for (; idx + 8 <= len; idx += 8)
+        {
+            uint64_t chunk;
+            std::memcpy(&chunk, str + idx, sizeof(chunk));
+            if (chunk & 0x8080808080808080ULL)
+                break;
+        }
+        while (idx < len && static_cast<unsigned char>(str[idx]) < 0x80)
+            ++idx;
+        return idx;
+    }
+
+    void appendWide(std::wstring& out, uint32_t codepoint)
+    {
+        if constexpr (sizeof(wchar_t) == 2)
+        {
+            if (codepoint >= 0x10000)
+            {
+                codepoint -= 0x10000;
+                out.push_back(static_cast<wchar_t>(0xD800 + (codepoint >> 10)));
+                out.push_back(static_cast<wchar_t>(0xDC00 + (codepoint & 0x3FF)));
+                return;
+            }
+        }
+        out.push_back(static_cast<wchar_t>(codepoint));
+    }
+
+    void appendUtf8(std::string& out, uint32_t codepoint)
+    {
+        if (codepoint < 0x80)
+        {
+            out.push_back(static_cast<char>(codepoint));
+        }
+        else if (codepoint < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+        else if (codepoint < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+    }
+}
+
+std::wstring fourdb::toWideStr(std::string_view str)
+{
+    std::wstring retVal;
+    retVal.reserve(str.size());
+
+    const char* bytes = str.data();
+    const size_t len = str.size();
+    size_t idx = 0;
+    while (idx < len)
+    {
+        size_t asciiCount = countAscii(bytes + idx, len - idx);
+        retVal.append(bytes + idx, bytes + idx + asciiCount);
+        idx += asciiCount;
+        if (idx >= len)
+            break;
+
+        // Multi-byte sequence, rejecting overlongs, surrogates, and anything past U+10FFFF
+        unsigned char lead = static_cast<unsigned char>(bytes[idx]);
+        size_t seqLen;
+        uint32_t codepoint, minCodepoint;
+        if ((lead & 0xE0) == 0xC0)
+        {
+            seqLen = 2; codepoint = lead & 0x1F; minCodepoint = 0x80;
+        }
+        else if ((lead & 0xF0) == 0xE0)
+        {
+            seqLen = 3; codepoint = lead & 0x0F; minCodepoint = 0x800;
+        }
+        else if ((lead & 0xF8) == 0xF0)
+        {
+            seqLen = 4; codepoint = lead & 0x07; minCodepoint = 0x10000;
+        }
+        else
+        {
+            retVal.push_back(REPLACEMENT_CHAR);
+            ++idx;
+            continue;
+        }
+
+        size_t seqIdx = 1;
+        for (; seqIdx < seqLen && idx + seqIdx < len; ++seqIdx)
+        {
+            unsigned char cont = static_cast<unsigned char>(bytes[idx + seqIdx]);
+            if ((cont & 0xC0) != 0x80)
+                break;
+            codepoint = (codepoint << 6) | (cont & 0x3F);
+        }
+
+        if (seqIdx < seqLen 
+            || codepoint < minCodepoint 
+            || codepoint > 0x10FFFF 
+            || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        {
+            retVal.push_back(REPLACEMENT_CHAR);
+            idx += seqIdx; // resume at whatever broke the sequence
+            continue;
+        }
+
+        appendWide(retVal, codepoint);
+        idx += seqLen;
+    }
+    return retVal;
+}
+
+std::string fourdb::toNarrowStr(std::wstring_view str)
+{
+    std::string retVal;
+    retVal.reserve(str.size());
+
+    const wchar_t* chars = str.data();
+    const size_t len = str.size();
+    size_t idx = 0;
+    while (idx < len)
+    {
+        // ASCII run, a simple loop the compiler can vectorize
+        size_t runEnd = idx;
+        while (runEnd < len && static_cast<uint32_t>(chars[runEnd]) < 0x80)
+            ++runEnd;
+        if (runEnd > idx)
+        {
+            size_t start = retVal.size();
+            retVal.resize(start + (runEnd - idx));
+            char* out = retVal.data() + start;
+            for (size_t c = idx; c < runEnd; ++c)
+                *out++ = static_cast<char>(chars[c]);
+            idx = runEnd;
+            if (idx >= len)
+                break;
+        }
+
+        uint32_t codepoint = static_cast<uint32_t>(chars[idx++]);
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF && sizeof(wchar_t) == 2 && idx < len)
+        {
+            uint32_t low = static_cast<uint32_t>(chars[idx]);
+            if (low >= 0xDC00 && low <= 0xDFFF)
+            {
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                ++idx;
+            }
+        }
+
+        if ((codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF)
+            codepoint = REPLACEMENT_CHAR;
+        appendUtf8(retVal, codepoint);
+    }
+    return retVal;
 }
 
 void fourdb::replace(std::wstring& str, const std::wstring& from, const std::wstring& to)
@@ -94,7 +271,9 @@ bool fourdb::isValidOp(const std::wstring& op)
         L"<=",
         L"!<",
         L"matches",
-        L"like"
+        L"like",
+        L"in",
+        L"between"
     };
     return ops.find(toLower(op)) != ops.end();
 }
@@ -19,24 +19,17 @@ namespace fourdb
 
     void replace(std::wstring& str, const std::wstring& from, const std::wstring& to);
 
-    inline std::string toNarrowStr(const std::wstring& str)
-    {
-        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-        return converter.to_bytes(str);
-    }
-
-    inline std::wstring toWideStr(const std::string& str)
-    {
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        return converter.from_bytes(str);
-    }
+    // UTF-8 <=> wchar_t strings, UTF-32 or UTF-16 depending on how big wchar_t is
+    // Runs of ASCII are copied straight across, invalid sequences become U+FFFD
+    std::string toNarrowStr(std::wstring_view str);
+    std::wstring toWideStr(std::string_view str);
 
     inline std::wstring toWideStr(const void* bytes)
     {
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        return converter.from_bytes(reinterpret_cast<const char*>(bytes));
+        return toWideStr(std::string_view(reinterpret_cast<const char*>(bytes)));
     }
 
+    // Shortest text that reads back as the same double, whole numbers without exponents
     std::wstring num2str(double num);
 
     bool isWord(const std::wstring& str);
@@ -9,7 +9,9 @@
 
 namespace fourdb
 {
-    ctxt::ctxt(const std::string& dbFilePath, bool clearCaches)
+    ctxt::ctxt(const std::string& dbFilePath, bool clearCaches, bool pooledReads)
+        : m_valueIdCache(DEFAULT_VALUE_CACHE_CAPACITY)
+        , m_compiledQueries(COMPILED_QUERY_CACHE_CAPACITY)
     {
         {
             static std::mutex mutex;
@@ -28,19 +30,56 @@ namespace fourdb
             }
         }
 
+        (void)clearCaches; // schema caching is per-ctxt now, there's nothing left over to clear
+
         m_db = std::make_shared<fourdb::db>(dbFilePath.c_str());
 
-        if (clearCaches)
+        // Wait out other connections' writes, like another ctxt upgrading the same file
+        m_db->execSql(L"PRAGMA busy_timeout = " + std::to_wstring(BUSY_TIMEOUT_MS));
+
+        // Only databases from before the latest schema get written to, opening to read doesn't
+        // Whoever gets the write lock first upgrades, the rest see the new user_version and back out
+        if (m_db->execScalarInt32(L"PRAGMA user_version").value_or(0) < SCHEMA_VERSION)
         {
-            names::clearCaches();
-            tables::clearCaches();
+            m_db->execSql(L"BEGIN IMMEDIATE");
+            try
+            {
+                if (m_db->execScalarInt32(L"PRAGMA user_version").value_or(0) < SCHEMA_VERSION)
+                {
+                    runSchemaSql(*m_db, items::upgradeSql());
+                    runSchemaSql(*m_db, values::upgradeSql());
+                    values::upgradeText(*m_db);
+                    m_db->execSql(L"PRAGMA user_version = " + std::to_wstring(SCHEMA_VERSION));
+                }
+                m_db->execSql(L"COMMIT");
+            }
+            catch (...)
+            {
+                m_db->execSql(L"ROLLBACK");
+                throw;
+            }
         }
+
+        m_catalog = std::make_shared<catalog>();
+        m_catalog->load(*m_db);
+        m_db->setCatalog(m_catalog);
+
+        if (pooledReads)
+            m_readPool = std::make_shared<dbpool>(dbFilePath, std::thread::hardware_concurrency(), m_catalog);
     }
 
     std::shared_ptr<dbreader> ctxt::execQuery(const select& query)
     {
-        std::wstring sql = sql::generateSql(*m_db, query);
-        return m_db->execReader(sql, query.cmdParams);
+        auto readDb = getReadDb();
+        std::wstring sql = getQuerySql(*readDb, query);
+        auto reader = readDb->execReader(sql, query.cmdParams);
+        if (readDb == m_db)
+            return reader;
+
+        // Keep the connection leased for as long as the reader is around
+        // NOTE: pair members are destroyed in reverse order, reader first
+        auto leased = std::make_shared<std::pair<std::shared_ptr<fourdb::db>, std::shared_ptr<dbreader>>>(readDb, reader);
+        return std::shared_ptr<dbreader>(leased, reader.get());
     }
 
     std::shared_ptr<dbreader> ctxt::execScalar(const select& query)
@@ -79,28 +118,237 @@ namespace fourdb
             return std::nullopt;
     }
 
+    std::optional<std::string> ctxt::execScalarStringUtf8(const select& query)
+    {
+        auto reader = execScalar(query);
+        if (reader != nullptr)
+            return std::string(reader->getStringUtf8(0));
+        else
+            return std::nullopt;
+    }
+
     int64_t ctxt::getRowId(const std::wstring& tableName, const strnum& key)
     {
-        validateTableName(tableName);
-        auto select = sql::parse(L"SELECT id FROM " + tableName + L" WHERE value = @value");
-        select.addParam(L"@value", key);
-        return execScalarInt64(select).value_or(-1);
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+            return -1;
+
+        return items::getRowId(*readDb, tableObj->id, tableObj->isNumeric, key);
     }
 
     std::optional<double> ctxt::getRowNumberValue(const std::wstring& tableName, int64_t rowId)
     {
-        validateTableName(tableName);
-        auto select = sql::parse(L"SELECT value FROM " + tableName + L" WHERE id = @id");
-        select.addParam(L"@id", static_cast<double>(rowId));
-        return execScalarDouble(select);
+        auto values = getRowNumberValues(tableName, std::vector<int64_t>{ rowId });
+        return values[0];
     }
 
     std::optional<std::wstring> ctxt::getRowStringValue(const std::wstring& tableName, int64_t rowId)
     {
-        validateTableName(tableName);
-        auto select = sql::parse(L"SELECT value FROM " + tableName + L" WHERE id = @id");
-        select.addParam(L"@id", static_cast<double>(rowId));
-        return execScalarString(select);
+        auto values = getRowStringValues(tableName, std::vector<int64_t>{ rowId });
+        return values[0];
+    }
+
+    std::optional<std::string> ctxt::getRowStringValueUtf8(const std::wstring& tableName, int64_t rowId)
+    {
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+            return std::nullopt;
+
+        auto key = items::getRowKey(*readDb, tableObj->id, tableObj->isNumeric, rowId);
+        if (!key.has_value())
+            return std::nullopt;
+        else if (key->isStr())
+            return key->utf8();
+        else
+            return toNarrowStr(num2str(key->num()));
+    }
+
+    std::vector<int64_t> ctxt::getRowIds(const std::wstring& tableName, const std::vector<strnum>& keys)
+    {
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+            return std::vector<int64_t>(keys.size(), -1);
+
+        return items::getRowIds(*readDb, tableObj->id, tableObj->isNumeric, keys);
+    }
+
+    std::vector<std::optional<double>> ctxt::getRowNumberValues(const std::wstring& tableName, const std::vector<int64_t>& rowIds)
+    {
+        std::vector<std::optional<double>> retVal(rowIds.size());
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+            return retVal;
+
+        auto keys = items::getRowKeys(*readDb, tableObj->id, tableObj->isNumeric, rowIds);
+        for (size_t k = 0; k < keys.size(); ++k)
+        {
+            if (!keys[k].has_value())
+                continue;
+            else if (keys[k]->isStr())
+                retVal[k] = atof(keys[k]->utf8().c_str()); // like SQLite would make of it
+            else
+                retVal[k] = keys[k]->num();
+        }
+        return retVal;
+    }
+
+    std::vector<std::optional<std::wstring>> ctxt::getRowStringValues(const std::wstring& tableName, const std::vector<int64_t>& rowIds)
+    {
+        std::vector<std::optional<std::wstring>> retVal(rowIds.size());
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+            return retVal;
+
+        auto keys = items::getRowKeys(*readDb, tableObj->id, tableObj->isNumeric, rowIds);
+        for (size_t k = 0; k < keys.size(); ++k)
+        {
+            if (!keys[k].has_value())
+                continue;
+            else if (keys[k]->isStr())
+                retVal[k] = keys[k]->str();
+            else
+                retVal[k] = num2str(keys[k]->num());
+        }
+        return retVal;
+    }
+
+    rowset ctxt::getRows(const std::wstring& tableName, const std::vector<strnum>& keys, const std::vector<std::wstring>& columns)
+    {
+        rowset rows;
+        rows.columns = columns;
+
+        // The reserved names are the row's own fields, like in a SELECT, the rest can't be had by row
+        for (const auto& column : rows.columns)
+        {
+            validateColumnName(column);
+            if 
+            (
+                isNameReserved(column) 
+                && 
+                column != L"value" && column != L"id" && column != L"created" && column != L"lastmodified"
+            )
+            {
+                throw fourdberr("Invalid getRows column: " + toNarrowStr(column));
+            }
+        }
+
+        auto readDb = getReadDb();
+        auto tableObj = getTableObj(*readDb, tableName);
+        if (!tableObj.has_value())
+        {
+            rows.values.resize(rows.columns.size());
+            return rows;
+        }
+
+        // All the columns, in name order like getSchema
+        auto snapshot = m_catalog->current();
+        if (rows.columns.empty())
+        {
+            auto tableNamesIt = snapshot->nameIds.find(tableObj->id);
+            if (tableNamesIt != snapshot->nameIds.end())
+            {
+                for (const auto& nameIt : tableNamesIt->second)
+                    rows.columns.push_back(nameIt.first);
+            }
+            std::sort(rows.columns.begin(), rows.columns.end());
+        }
+
+        // Name IDs to where they go, the names not found just stay empty
+        std::vector<int> nameIds;
+        std::unordered_map<int, size_t> nameColumns;
+        bool wantsTimes = false;
+        for (size_t c = 0; c < rows.columns.size(); ++c)
+        {
+            if (isNameReserved(rows.columns[c]))
+            {
+                wantsTimes = wantsTimes || rows.columns[c] == L"created" || rows.columns[c] == L"lastmodified";
+                continue;
+            }
+
+            int nameId = names::getId(*readDb, tableObj->id, rows.columns[c], false, true, true);
+            if (nameId >= 0 && nameColumns.insert({ nameId, c }).second)
+                nameIds.push_back(nameId);
+        }
+
+        std::vector<int64_t> foundRowIds;
+        auto rowIds = items::getRowIds(*readDb, tableObj->id, tableObj->isNumeric, keys);
+        for (size_t k = 0; k < keys.size(); ++k)
+        {
+            if (rowIds[k] >= 0)
+            {
+                rows.keys.push_back(keys[k]);
+                foundRowIds.push_back(rowIds[k]);
+            }
+        }
+
+        rows.values.resize(rows.columns.size(), std::vector<std::optional<strnum>>(foundRowIds.size()));
+
+        if (!nameIds.empty())
+        {
+            items::getItemsValues
+            (
+                *readDb, 
+                foundRowIds, 
+                nameIds, 
+                [&](size_t rowIdx, int nameId, strnum&& value)
+                {
+                    rows.values[nameColumns[nameId]][rowIdx] = std::move(value);
+                }
+            );
+        }
+
+        std::vector<strnum> createds, lastmodifieds;
+        if (wantsTimes)
+        {
+            createds.resize(foundRowIds.size());
+            lastmodifieds.resize(foundRowIds.size());
+            items::getItemsTimes
+            (
+                *readDb, 
+                foundRowIds, 
+                [&](size_t rowIdx, strnum&& created, strnum&& lastmodified)
+                {
+                    createds[rowIdx] = std::move(created);
+                    lastmodifieds[rowIdx] = std::move(lastmodified);
+                }
+            );
+        }
+
+        for (size_t c = 0; c < rows.columns.size(); ++c)
+        {
+            const std::wstring& column = rows.columns[c];
+            for (size_t r = 0; r < foundRowIds.size(); ++r)
+            {
+                if (column == L"value")
+                    rows.values[c][r] = rows.keys[r];
+                else if (column == L"id")
+                    rows.values[c][r] = strnum(static_cast<double>(foundRowIds[r]));
+                else if (column == L"created")
+                    rows.values[c][r] = createds[r];
+                else if (column == L"lastmodified")
+                    rows.values[c][r] = lastmodifieds[r];
+            }
+        }
+
+        // The same column asked for twice
+        for (size_t c = 0; c < rows.columns.size(); ++c)
+        {
+            for (size_t o = 0; o < c; ++o)
+            {
+                if (rows.columns[o] == rows.columns[c])
+                {
+                    rows.values[c] = rows.values[o];
+                    break;
+                }
+            }
+        }
+
+        return rows;
     }
 
     void ctxt::define(const std::wstring& table, const strnum& key, const paramap& columnData)
@@ -114,84 +362,227 @@ namespace fourdb
         if (keysToColumnData.empty())
             return;
 
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        defineNoLock(table, keysToColumnData, pacifier, false);
+    }
+
+    void ctxt::defineNoLock(const std::wstring& table, const std::unordered_map<strnum, paramap>& keysToColumnData, const std::function<void(const wchar_t*)>& pacifier, bool inTransaction)
+    {
         pacifier(L"Setting up shop");
-        std::vector<strnum> keys;
+        bool firstIsString = keysToColumnData.begin()->first.isStr();
+        std::vector<std::pair<const strnum*, const paramap*>> rows;
+        rows.reserve(keysToColumnData.size());
         for (const auto& it : keysToColumnData)
-            keys.push_back(it.first);
-
-        strnum firstKey = keys[0];
-        bool firstIsString = firstKey.isStr();
-        for (const auto& key : keys)
         {
-            if (key.isStr() != firstIsString)
+            if (it.first.isStr() != firstIsString)
                 throw fourdberr("Not all primary keys are of the same data type, string or number");
+            rows.push_back({ &it.first, &it.second });
         }
 
         pacifier(L"Seeding database");
         bool isKeyNumeric = !firstIsString;
-        int tableId = tables::getId(*m_db, table, isKeyNumeric);
-        std::unordered_map<std::wstring, int64_t> valueIdCache;
-        std::vector<std::wstring> allSqlStatements;
-        for (const auto& keyToColumnData : keysToColumnData)
+        if (!inTransaction)
+            m_db->execSql(L"BEGIN");
+        try
         {
-            const strnum& key = keyToColumnData.first;
-            const paramap& columnData = keyToColumnData.second;
+            int tableId = tables::getId(*m_db, table, isKeyNumeric);
 
-            int64_t tableValueId = values::getId(*m_db, key); // no need to cache, all unique
-            int64_t itemId = items::getId(*m_db, tableId, tableValueId);
-            if (columnData.empty())
-                continue;
+            pacifier(L"Populating database");
+            defineRows(tableId, rows);
 
-            std::unordered_map<int, int64_t> nameValueIds;
-            for (const auto& nameValue : columnData)
+            if (!inTransaction)
+                m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            if (!inTransaction)
             {
-                const std::wstring& name = nameValue.first;
-                const strnum& value = nameValue.second;
+                m_db->execSql(L"ROLLBACK");
+                onRollback();
+            }
+            throw;
+        }
+    }
 
-                bool isMetadataNumeric = !value.isStr();
+    void ctxt::defineStream(const std::wstring& table, const std::function<bool(strnum&, paramap&)>& generator, const std::function<void(const wchar_t*)>& pacifier, size_t commitEvery)
+    {
+        if (commitEvery == 0)
+            commitEvery = 1;
 
-                int nameId = names::getId(*m_db, tableId, name, isMetadataNumeric);
-                bool isNameNumeric = names::getNameIsNumeric(*m_db, nameId);
+        std::lock_guard<std::mutex> lock(m_writeMutex);
 
-                if (isMetadataNumeric != isNameNumeric)
-                    throw fourdberr("Data numeric does not match name");
+        std::vector<std::pair<strnum, paramap>> chunk(1);
+        if (!generator(chunk[0].first, chunk[0].second))
+            return;
+        bool firstIsString = chunk[0].first.isStr();
+
+        auto startTime = std::chrono::steady_clock::now();
+        auto reportProgress = [&](size_t rowCount)
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            double rowsPerSecond = seconds > 0.0 ? rowCount / seconds : 0.0;
+            std::wstring msg = 
+                L"Populating database: " + std::to_wstring(rowCount) + L" rows, " + 
+                std::to_wstring(static_cast<int64_t>(rowsPerSecond)) + L" rows/sec";
+            pacifier(msg.c_str());
+        };
 
-                int64_t valueId = -1;
+        size_t rowCount = 0;
+        std::vector<std::pair<const strnum*, const paramap*>> rows;
+        m_db->execSql(L"BEGIN");
+        try
+        {
+            int tableId = tables::getId(*m_db, table, !firstIsString);
+            bool moreRows = true;
+            while (moreRows)
+            {
+                // Pull in up to a chunk of rows
+                while (chunk.size() < commitEvery)
                 {
-                    std::wstring cacheKey =
-                        value.isStr() ? (L"$" + value.str()) : (L"#" + num2str(value.num()));
-                    const auto& cacheIt = valueIdCache.find(cacheKey);
-                    if (cacheIt == valueIdCache.end())
+                    chunk.emplace_back();
+                    if (!generator(chunk.back().first, chunk.back().second))
                     {
-                        valueId = values::getId(*m_db, value);
-                        valueIdCache.insert({ cacheKey, valueId });
+                        chunk.pop_back();
+                        moreRows = false;
+                        break;
                     }
-                    else
-                        valueId = cacheIt->second;
                 }
-                nameValueIds[nameId] = valueId;
-            }
 
-            auto sqlStatements = items::setItemDataSql(itemId, nameValueIds);
-            allSqlStatements.insert(allSqlStatements.end(), sqlStatements.begin(), sqlStatements.end());
-        }
+                rows.clear();
+                for (const auto& row : chunk)
+                {
+                    if (row.first.isStr() != firstIsString)
+                        throw fourdberr("Not all primary keys are of the same data type, string or number");
+                    rows.push_back({ &row.first, &row.second });
+                }
+                defineRows(tableId, rows);
+                rowCount += chunk.size();
+                chunk.clear();
 
-        pacifier(L"Populating database");
-        try
-        {
-            m_db->execSql(L"BEGIN");
-            for (const auto& sql : allSqlStatements)
-                m_db->execSql(sql);
-            m_db->execSql(L"COMMIT");
+                m_db->execSql(L"COMMIT");
+                reportProgress(rowCount);
+                if (moreRows)
+                    m_db->execSql(L"BEGIN");
+            }
         }
         catch (...)
         {
             m_db->execSql(L"ROLLBACK");
+            onRollback();
             throw;
         }
     }
 
+    void ctxt::defineRows(int tableId, const std::vector<std::pair<const strnum*, const paramap*>>& rows)
+    {
+        // Another connection may have compacted away values that are in the cache
+        int64_t dataVersion = m_db->execScalarInt64(L"PRAGMA data_version").value_or(0);
+        if (dataVersion != m_valueCacheDataVersion)
+        {
+            m_valueIdCache.clear();
+            m_valueCacheDataVersion = dataVersion;
+        }
+
+        for (size_t start = 0; start < rows.size(); start += DEFINE_CHUNK_SIZE)
+        {
+            size_t end = std::min(rows.size(), start + DEFINE_CHUNK_SIZE);
+
+            // Resolve the names, and gather up the values, keys included
+            // Column values are often repeated across calls, so look in the cache first,
+            // keys are not, so they go straight to the database
+            std::vector<strnum> valuesToResolve;
+            std::unordered_map<strnum, int64_t> cachedValueIds;
+            std::unordered_set<strnum> missedValues;
+            std::unordered_map<std::wstring, int> nameIds;
+            for (size_t idx = start; idx < end; ++idx)
+            {
+                valuesToResolve.push_back(*rows[idx].first);
+                for (const auto& nameValue : *rows[idx].second)
+                {
+                    const std::wstring& name = nameValue.first;
+                    const strnum& value = nameValue.second;
+
+                    bool isMetadataNumeric = !value.isStr();
+
+                    auto nameIt = nameIds.find(name);
+                    if (nameIt == nameIds.end())
+                        nameIt = nameIds.insert({ name, names::getId(*m_db, tableId, name, isMetadataNumeric) }).first;
+
+                    bool isNameNumeric = names::getNameIsNumeric(*m_db, nameIt->second);
+                    if (isMetadataNumeric != isNameNumeric)
+                        throw fourdberr("Data numeric does not match name");
+
+                    if (cachedValueIds.find(value) != cachedValueIds.end() || missedValues.find(value) != missedValues.end())
+                        continue;
+
+                    int64_t valueId;
+                    if (m_valueIdCache.tryGet(value, valueId))
+                    {
+                        cachedValueIds.insert({ value, valueId });
+                    }
+                    else
+                    {
+                        missedValues.insert(value);
+                        valuesToResolve.push_back(value);
+                    }
+                }
+            }
+
+            auto valueIds = values::getIds(*m_db, valuesToResolve);
+            for (const auto& value : missedValues)
+                m_valueIdCache.put(value, valueIds[value]);
+            valueIds.insert(cachedValueIds.begin(), cachedValueIds.end());
+
+            // Only the searchable columns pay for full-text indexing
+            auto snapshot = m_catalog->current();
+            auto searchIt = snapshot->searchNameIds.find(tableId);
+            if (searchIt != snapshot->searchNameIds.end())
+            {
+                for (int searchNameId : searchIt->second)
+                {
+                    std::vector<int64_t> textValueIds;
+                    for (size_t idx = start; idx < end; ++idx)
+                    {
+                        if (searchNameId == 0)
+                        {
+                            textValueIds.push_back(valueIds[*rows[idx].first]);
+                            continue;
+                        }
+
+                        for (const auto& nameValue : *rows[idx].second)
+                        {
+                            if (nameIds[nameValue.first] == searchNameId)
+                                textValueIds.push_back(valueIds[nameValue.second]);
+                        }
+                    }
+                    values::addText(*m_db, tableId, searchNameId, textValueIds);
+                }
+            }
+
+            for (size_t idx = start; idx < end; ++idx)
+            {
+                int64_t itemId = items::getId(*m_db, tableId, valueIds[*rows[idx].first]);
+
+                const paramap& columnData = *rows[idx].second;
+                if (columnData.empty())
+                    continue;
+
+                std::unordered_map<int, int64_t> nameValueIds;
+                for (const auto& nameValue : columnData)
+                    nameValueIds[nameIds[nameValue.first]] = valueIds[nameValue.second];
+
+                items::setItemData(*m_db, itemId, nameValueIds);
+            }
+        }
+    }
+
     void ctxt::undefine(const std::wstring& table, const strnum& key, const std::wstring& name)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        undefineNoLock(table, key, name);
+    }
+
+    void ctxt::undefineNoLock(const std::wstring& table, const strnum& key, const std::wstring& name)
     {
         bool isKeyNumeric = !key.isStr();
         int tableId = tables::getId(*m_db, table, isKeyNumeric, true);
@@ -201,9 +592,67 @@ namespace fourdb
         items::removeItemData(*m_db, itemId, nameId);
     }
 
+    void ctxt::startWriteQueue(std::chrono::milliseconds window)
+    {
+        std::lock_guard<std::mutex> lock(m_writeQueueMutex);
+        m_writeQueue.reset(); // drain any current one first
+        m_writeQueue = newWriteQueue(window);
+    }
+
+    void ctxt::stopWriteQueue()
+    {
+        std::lock_guard<std::mutex> lock(m_writeQueueMutex);
+        m_writeQueue.reset();
+    }
+
+    std::future<void> ctxt::defineAsync(const std::wstring& table, const strnum& key, const paramap& columnData)
+    {
+        return getWriteQueue()->enqueue([this, table, key, columnData]()
+        {
+            std::unordered_map<strnum, paramap> keysToColumnData{ { key, columnData } };
+            defineNoLock(table, keysToColumnData, [](const wchar_t* str) { (void)str; }, true);
+        });
+    }
+
+    std::future<void> ctxt::undefineAsync(const std::wstring& table, const strnum& key, const std::wstring& name)
+    {
+        return getWriteQueue()->enqueue([this, table, key, name]()
+        {
+            undefineNoLock(table, key, name);
+        });
+    }
+
+    std::future<void> ctxt::deleteRowAsync(const std::wstring& table, const strnum& key)
+    {
+        return getWriteQueue()->enqueue([this, table, key]()
+        {
+            deleteRowsNoLock(table, std::vector<strnum>{ key }, true);
+        });
+    }
+
+    std::shared_ptr<writequeue> ctxt::getWriteQueue()
+    {
+        std::lock_guard<std::mutex> lock(m_writeQueueMutex);
+        if (!m_writeQueue)
+            m_writeQueue = newWriteQueue(std::chrono::milliseconds(10));
+        return m_writeQueue;
+    }
+
+    std::shared_ptr<writequeue> ctxt::newWriteQueue(std::chrono::milliseconds window)
+    {
+        return 
+            std::make_shared<writequeue>
+            (
+                *m_db, 
+                m_writeMutex, 
+                window, 
+                [this]() { onRollback(); }
+            );
+    }
+
     std::wstring ctxt::generateSql(const select& query)
     {
-        std::wstring sql = sql::generateSql(*m_db, query);
+        std::wstring sql = getQuerySql(*getReadDb(), query);
         return sql;
     }
 
@@ -214,38 +663,272 @@ namespace fourdb
 
     void ctxt::deleteRows(const std::wstring& table, const std::vector<strnum>& keys)
     {
-        int tableId = tables::getId(*m_db, table, true);
-        for (auto val : keys)
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        deleteRowsNoLock(table, keys, false);
+    }
+
+    void ctxt::deleteRowsNoLock(const std::wstring& table, const std::vector<strnum>& keys, bool inTransaction)
+    {
+        int tableId = tables::getId(*m_db, table, true, true, true);
+        if (tableId < 0 || keys.empty())
+            return;
+
+        if (!inTransaction)
+            m_db->execSql(L"BEGIN");
+        try
         {
-            int64_t valueId = values::getId(*m_db, val);
-            std::wstring sql = L"DELETE FROM items WHERE valueid = " + std::to_wstring(valueId) + L" AND tableid = " + std::to_wstring(tableId);
-            m_db->execSql(sql);
+            items::deleteItems(*m_db, tableId, keys);
+
+            if (!inTransaction)
+                m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            if (!inTransaction)
+            {
+                m_db->execSql(L"ROLLBACK");
+                onRollback();
+            }
+            throw;
         }
     }
 
     bool ctxt::drop(const std::wstring& table)
     {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
         int tableId = tables::getId(*m_db, table, true, true, true);
         if (tableId < 0)
             return false;
 
-        m_db->execSql(L"DELETE FROM itemnamevalues WHERE nameid IN (SELECT id FROM names WHERE tableid = " + std::to_wstring(tableId) + L")");
-        m_db->execSql(L"DELETE FROM names WHERE tableid = " + std::to_wstring(tableId));
-        m_db->execSql(L"DELETE FROM items WHERE tableid = " + std::to_wstring(tableId));
-        m_db->execSql(L"DELETE FROM tables WHERE id = " + std::to_wstring(tableId));
+        // All or nothing, a half-dropped table would be left with search and index tables missing
+        m_db->execSql(L"BEGIN IMMEDIATE");
+        try
+        {
+            for (const auto& searchColumn : values::getSearchColumns(*m_db))
+            {
+                if (searchColumn.first == tableId)
+                    values::removeSearch(*m_db, tableId, searchColumn.second);
+            }
+
+            for (const auto& indexColumn : items::getIndexColumns(*m_db))
+            {
+                if (indexColumn.first == tableId)
+                    items::removeColumnIndex(*m_db, tableId, indexColumn.second);
+            }
+
+            paramap params{ { L"@tableId", tableId } };
+            m_db->execSql(L"DELETE FROM itemnamevalues WHERE nameid IN (SELECT id FROM names WHERE tableid = @tableId)", params);
+            m_db->execSql(L"DELETE FROM names WHERE tableid = @tableId", params);
+            m_db->execSql(L"DELETE FROM items WHERE tableid = @tableId", params);
+            m_db->execSql(L"DELETE FROM tables WHERE id = @tableId", params);
+
+            m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            m_db->execSql(L"ROLLBACK");
+            onRollback();
+            throw;
+        }
 
-        names::clearCaches();
-        tables::clearCaches();
+        m_catalog->load(*m_db);
 
         return true;
     }
 
     void ctxt::reset()
     {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
         items::reset(*m_db);
         values::reset(*m_db);
         names::reset(*m_db);
         tables::reset(*m_db);
+        m_valueIdCache.clear();
+    }
+
+    ctxt::compactstats ctxt::compact()
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        compactstats stats;
+
+        auto getFileBytes = [this]()
+        {
+            return 
+                m_db->execScalarInt64(L"PRAGMA page_count").value_or(0) 
+                * 
+                m_db->execScalarInt64(L"PRAGMA page_size").value_or(0);
+        };
+        int64_t startBytes = getFileBytes();
+
+        items::ensureValueIndex(*m_db);
+
+        // Start over from the beginning, with no deadline
+        m_compactAfterId = 0;
+        stats.valuesRemoved = compactNoLock(std::chrono::steady_clock::time_point::max(), stats.finished);
+
+        values::optimizeText(*m_db);
+        m_db->execSql(L"VACUUM");
+
+        stats.bytesReclaimed = startBytes - getFileBytes();
+        return stats;
+    }
+
+    ctxt::compactstats ctxt::compact(std::chrono::milliseconds budget)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        compactstats stats;
+
+        items::ensureValueIndex(*m_db);
+
+        // Deleting full-text entries writes to the index too, so this can come out behind
+        int64_t startFreeBytes = getFreeBytes();
+        stats.valuesRemoved = compactNoLock(std::chrono::steady_clock::now() + budget, stats.finished);
+        stats.bytesReclaimed = std::max(getFreeBytes() - startFreeBytes, int64_t(0));
+
+        return stats;
+    }
+
+    int64_t ctxt::compactNoLock(std::chrono::steady_clock::time_point deadline, bool& finished)
+    {
+        int64_t maxId = m_db->execScalarInt64(L"SELECT IFNULL(MAX(id), 0) FROM bvalues").value_or(0);
+
+        int64_t removed = 0;
+        finished = false;
+        do
+        {
+            if (m_compactAfterId >= maxId)
+            {
+                m_compactAfterId = 0;
+                finished = true;
+                break;
+            }
+
+            // One transaction per range of IDs so writers are not held up for long
+            int64_t upToId = std::min(m_compactAfterId + COMPACT_ID_RANGE, maxId);
+            m_db->execSql(L"BEGIN");
+            try
+            {
+                for (const auto& searchColumn : values::getSearchColumns(*m_db))
+                    values::deleteStaleText(*m_db, searchColumn.first, searchColumn.second, m_compactAfterId, upToId);
+
+                int deleted = values::deleteOrphans(*m_db, m_compactAfterId, upToId);
+                m_db->execSql(L"COMMIT");
+
+                // The cache may well have IDs of values that are no more
+                if (deleted > 0)
+                    m_valueIdCache.clear();
+                removed += deleted;
+            }
+            catch (...)
+            {
+                m_db->execSql(L"ROLLBACK");
+                onRollback();
+                throw;
+            }
+            m_compactAfterId = upToId;
+        } while (std::chrono::steady_clock::now() < deadline);
+
+        return removed;
+    }
+
+    int64_t ctxt::getFreeBytes()
+    {
+        return 
+            m_db->execScalarInt64(L"PRAGMA freelist_count").value_or(0) 
+            * 
+            m_db->execScalarInt64(L"PRAGMA page_size").value_or(0);
+    }
+
+    void ctxt::setSearchable(const std::wstring& table, const std::wstring& column, bool searchable)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        int tableId = tables::getId(*m_db, table, false, true);
+
+        m_db->execSql(L"BEGIN");
+        try
+        {
+            int nameId;
+            bool isNumeric;
+            if (column == L"value")
+            {
+                nameId = 0;
+                isNumeric = tables::getTable(*m_db, tableId)->isNumeric;
+            }
+            else
+            {
+                nameId = names::getId(*m_db, tableId, column, false, !searchable, true);
+                isNumeric = names::getNameIsNumeric(*m_db, nameId);
+            }
+
+            if (nameId >= 0)
+            {
+                if (!searchable)
+                    values::removeSearch(*m_db, tableId, nameId);
+                else if (isNumeric)
+                    throw fourdberr("Only string columns can be searchable: " + toNarrowStr(column));
+                else
+                    values::addSearch(*m_db, tableId, nameId);
+            }
+
+            m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            m_db->execSql(L"ROLLBACK");
+            onRollback();
+            throw;
+        }
+
+        m_catalog->load(*m_db);
+    }
+
+    void ctxt::createIndex(const std::wstring& table, const std::wstring& column)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        int tableId = tables::getId(*m_db, table, false, true);
+        int nameId = names::getId(*m_db, tableId, column, false, true);
+
+        m_db->execSql(L"BEGIN");
+        try
+        {
+            items::addColumnIndex(*m_db, tableId, nameId, names::getNameIsNumeric(*m_db, nameId));
+            m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            m_db->execSql(L"ROLLBACK");
+            onRollback();
+            throw;
+        }
+
+        m_catalog->load(*m_db);
+    }
+
+    void ctxt::dropIndex(const std::wstring& table, const std::wstring& column)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        int tableId = tables::getId(*m_db, table, false, true, true);
+        if (tableId < 0)
+            return;
+
+        int nameId = names::getId(*m_db, tableId, column, false, true, true);
+        if (nameId < 0 || !items::isColumnIndexed(*m_db, tableId, nameId))
+            return;
+
+        m_db->execSql(L"BEGIN");
+        try
+        {
+            items::removeColumnIndex(*m_db, tableId, nameId);
+            m_db->execSql(L"COMMIT");
+        }
+        catch (...)
+        {
+            m_db->execSql(L"ROLLBACK");
+            onRollback();
+            throw;
+        }
+
+        m_catalog->load(*m_db);
     }
 
     virtualschema ctxt::getSchema(const std::wstring& table)
@@ -265,7 +948,8 @@ namespace fourdb
             cmdParams.insert({ L"@name", table });
 
         virtualschema response;
-        auto reader = m_db->execReader(sql, cmdParams);
+        auto readDb = getReadDb();
+        auto reader = readDb->execReader(sql, cmdParams);
         while (reader->read())
         {
             std::wstring curTable = reader->getString(0);
@@ -281,6 +965,7 @@ namespace fourdb
 
     int ctxt::ensureTable(const std::wstring& name, bool isNumeric)
     {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
         return tables::getId(*m_db, name, isNumeric);
     }
 
@@ -289,4 +974,69 @@ namespace fourdb
         for (size_t idx = 0; queries[idx] != nullptr; ++idx)
             db.execSql(queries[idx]);
     }
+
+    void ctxt::onRollback()
+    {
+        // Anything cached during the transaction may refer to rows that are no more
+        m_catalog->load(*m_db);
+        m_valueIdCache.clear();
+    }
+
+    ctxt::valuecachestats ctxt::getValueCacheStats()
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        valuecachestats stats;
+        stats.hits = m_valueIdCache.hits();
+        stats.misses = m_valueIdCache.misses();
+        stats.size = m_valueIdCache.size();
+        stats.capacity = m_valueIdCache.capacity();
+        return stats;
+    }
+
+    void ctxt::setValueCacheCapacity(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_valueIdCache.setCapacity(capacity);
+    }
+
+    std::wstring ctxt::getQuerySql(fourdb::db& db, const select& query)
+    {
+        // The generated SQL has table and column IDs baked in, so the schema version is part of the key
+        std::wstring key = sql::getQueryKey(query) + L"|V:" + std::to_wstring(m_catalog->current()->version);
+        {
+            std::lock_guard<std::mutex> lock(m_compiledQueriesMutex);
+            std::wstring sql;
+            if (m_compiledQueries.tryGet(key, sql))
+                return sql;
+        }
+
+        bool allNamesFound = false;
+        std::wstring sql = sql::generateSql(db, query, &allNamesFound);
+
+        // Missing tables and columns may be added by other connections without our catalog knowing
+        if (allNamesFound)
+        {
+            std::lock_guard<std::mutex> lock(m_compiledQueriesMutex);
+            m_compiledQueries.put(key, sql);
+        }
+        return sql;
+    }
+
+    std::optional<tables::table_obj> ctxt::getTableObj(fourdb::db& db, const std::wstring& tableName)
+    {
+        validateTableName(tableName);
+        int tableId = tables::getId(db, tableName, false, true, true);
+        if (tableId < 0)
+            return std::nullopt;
+        else
+            return tables::getTable(db, tableId);
+    }
+
+    std::shared_ptr<fourdb::db> ctxt::getReadDb()
+    {
+        if (m_readPool)
+            return m_readPool->lease();
+        else
+            return m_db;
+    }
 }
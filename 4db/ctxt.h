@@ -1,8 +1,12 @@
 ﻿#pragma once
 
+#include "catalog.h"
 #include "db.h"
+#include "dbpool.h"
+#include "lrucache.h"
 #include "sql.h"
 #include "types.h"
+#include "writequeue.h"
 
 namespace fourdb
 {
@@ -19,17 +23,23 @@ namespace fourdb
         /// If the file does not exist, an empty database is created and initialized
 		/// </summary>
 		/// <param name="dbFilePath">file path for the database</param>
-        ctxt(const std::string& dbFilePath, bool clearCaches = false);
+        /// <param name="clearCaches">No longer needed, each ctxt loads its own schema catalog</param>
+        /// <param name="pooledReads">Run queries on a pool of read-only connections, one per core,
+        /// so threads sharing this can query in parallel; writes still go through one connection</param>
+        ctxt(const std::string& dbFilePath, bool clearCaches = false, bool pooledReads = false);
 
         ~ctxt()
         {
+            m_writeQueue.reset();
+            m_readPool.reset();
             m_db.reset();
         }
 
         /// <summary>
         /// Access the SQLite wrapper object
+        /// This is the writer connection
         /// </summary>
-        db& db()
+        fourdb::db& db()
         {
             return *m_db;
         }
@@ -69,6 +79,13 @@ namespace fourdb
         /// <returns>optional string</returns>
         std::optional<std::wstring> execScalarString(const select& query);
 
+        /// <summary>
+        /// Issue a string scalar query, getting UTF-8 back
+        /// </summary>
+        /// <param name="query">virtual query object from sql::parse</param>
+        /// <returns>optional UTF-8 string</returns>
+        std::optional<std::string> execScalarStringUtf8(const select& query);
+
         /// <summary>
         /// Given a table and a primary key, get the items table's row ID
         /// Useful for having a column in one virtual table
@@ -87,6 +104,36 @@ namespace fourdb
         /// </summary>
         std::optional<std::wstring> getRowStringValue(const std::wstring& tableName, int64_t rowId);
 
+        /// <summary>
+        /// Given a table and a row ID, get the primary key as a UTF-8 string.
+        /// </summary>
+        std::optional<std::string> getRowStringValueUtf8(const std::wstring& tableName, int64_t rowId);
+
+        /// <summary>
+        /// Given a table and primary keys, get the items table's row IDs in one go
+        /// </summary>
+        /// <returns>Row IDs in the order of the keys, -1 for those not found</returns>
+        std::vector<int64_t> getRowIds(const std::wstring& tableName, const std::vector<strnum>& keys);
+
+        /// <summary>
+        /// Given a table and row IDs, get the primary keys as numbers in one go
+        /// </summary>
+        std::vector<std::optional<double>> getRowNumberValues(const std::wstring& tableName, const std::vector<int64_t>& rowIds);
+
+        /// <summary>
+        /// Given a table and row IDs, get the primary keys as strings in one go
+        /// </summary>
+        std::vector<std::optional<std::wstring>> getRowStringValues(const std::wstring& tableName, const std::vector<int64_t>& rowIds);
+
+        /// <summary>
+        /// Get the column data of many rows in one go, instead of a query per row
+        /// </summary>
+        /// <param name="tableName">Table of the rows</param>
+        /// <param name="keys">Primary keys of the rows; keys not found are left out</param>
+        /// <param name="columns">Columns to get, all of the table's columns if empty</param>
+        /// <returns>The rows found, in the order of the keys, kept by column</returns>
+        rowset getRows(const std::wstring& tableName, const std::vector<strnum>& keys, const std::vector<std::wstring>& columns = {});
+
         /// <summary>
         /// UPSERT: Give it a table name, a primary key, and column data, and it does the rest
         /// </summary>
@@ -104,6 +151,47 @@ namespace fourdb
         /// <param name="pacifier">Pass in a callback for progress notifications</param>
         void define(const std::wstring& table, const std::unordered_map<strnum, paramap>& keysToColumnData, const std::function<void(const wchar_t*)>& pacifier);
 
+        /// <summary>
+        /// UPSERT: Streaming version of the define function for imports too big to hold in memory
+        /// Rows are pulled from the generator and written as they come,
+        /// committing every so many rows, so memory use stays flat
+        /// If something goes wrong, the rows committed before the problem stay committed
+        /// </summary>
+        /// <param name="table">Name of the table to UPSERT into; table created automatically</param>
+        /// <param name="generator">Fills in the next primary key and column data, returns false when there are no more rows</param>
+        /// <param name="pacifier">Pass in a callback for progress notifications, rows and rows per second</param>
+        /// <param name="commitEvery">How many rows to write per transaction</param>
+        void defineStream
+        (
+            const std::wstring& table, 
+            const std::function<bool(strnum&, paramap&)>& generator, 
+            const std::function<void(const wchar_t*)>& pacifier, 
+            size_t commitEvery = 10000
+        );
+
+        /// <summary>
+        /// UPSERT: Streaming define over a range of key-column data pairs, see defineStream
+        /// </summary>
+        template <typename It>
+        void defineStream(const std::wstring& table, It begin, It end, const std::function<void(const wchar_t*)>& pacifier, size_t commitEvery = 10000)
+        {
+            defineStream
+            (
+                table,
+                [&begin, &end](strnum& key, paramap& columnData)
+                {
+                    if (begin == end)
+                        return false;
+                    key = begin->first;
+                    columnData = begin->second;
+                    ++begin;
+                    return true;
+                },
+                pacifier,
+                commitEvery
+            );
+        }
+
         /// <summary>
         /// Okay fine, there are 5 things you can do.  UNDEFINE.
         /// I didn't want to add a notion of a null strnum, either in strnum, or in paramap.
@@ -115,6 +203,37 @@ namespace fourdb
         /// <param name="name">Name of the column data to return</param>
         void undefine(const std::wstring& table, const strnum& key, const std::wstring& name);
 
+        /// <summary>
+        /// Start the background writer that the *Async functions hand their work to
+        /// Everything queued up within the commit window is written in one transaction
+        /// The *Async functions start the writer with the default window if need be
+        /// </summary>
+        /// <param name="window">How long to gather operations before committing</param>
+        void startWriteQueue(std::chrono::milliseconds window = std::chrono::milliseconds(10));
+
+        /// <summary>
+        /// Write out whatever is queued up and stop the background writer
+        /// </summary>
+        void stopWriteQueue();
+
+        /// <summary>
+        /// Queued up UPSERT, see define
+        /// </summary>
+        /// <returns>future that is ready once the row is committed, or carries the exception</returns>
+        std::future<void> defineAsync(const std::wstring& table, const strnum& key, const paramap& columnData);
+
+        /// <summary>
+        /// Queued up UNDEFINE, see undefine
+        /// </summary>
+        /// <returns>future that is ready once the change is committed, or carries the exception</returns>
+        std::future<void> undefineAsync(const std::wstring& table, const strnum& key, const std::wstring& name);
+
+        /// <summary>
+        /// Queued up row removal, see deleteRow
+        /// </summary>
+        /// <returns>future that is ready once the removal is committed, or carries the exception</returns>
+        std::future<void> deleteRowAsync(const std::wstring& table, const strnum& key);
+
         /// <summary>
         /// Given a virtual query, generate the SQLite SQL for executing the query.
         /// </summary>
@@ -147,6 +266,60 @@ namespace fourdb
         /// </summary>
         void reset();
 
+        /// <summary>
+        /// What compact got done
+        /// </summary>
+        struct compactstats
+        {
+            int64_t valuesRemoved = 0;
+            int64_t bytesReclaimed = 0;
+            bool finished = false; // made it through all the values
+        };
+
+        /// <summary>
+        /// Remove the values that no rows refer to anymore, left behind by
+        /// drop, deleteRows, and define overwriting column data,
+        /// and the full-text entries of values columns no longer have, then VACUUM to shrink the file
+        /// </summary>
+        /// <returns>How many values were removed and how much smaller the file got</returns>
+        compactstats compact();
+
+        /// <summary>
+        /// Incremental compact: remove unreferenced values a range of IDs at a time
+        /// until the time budget is spent, picking up where the last call left off
+        /// Space is freed up for reuse inside the file; only compact() shrinks the file
+        /// </summary>
+        /// <param name="budget">How long to keep at it, at least one range of IDs is done</param>
+        /// <returns>How many values were removed, how many bytes were freed up, and whether all values have been gone through</returns>
+        compactstats compact(std::chrono::milliseconds budget);
+
+        /// <summary>
+        /// Make a column searchable with MATCHES, or not
+        /// Each searchable column gets its own full-text index, so a search only looks at that column,
+        /// and define only does full-text indexing for searchable columns
+        /// The column is added as a string column if need be; use "value" for the primary key
+        /// </summary>
+        /// <param name="table">Table of the column, which must exist</param>
+        /// <param name="column">Name of the column, which must be a string column</param>
+        /// <param name="searchable">Whether to make the column searchable, or stop it being searchable</param>
+        void setSearchable(const std::wstring& table, const std::wstring& column, bool searchable = true);
+
+        /// <summary>
+        /// Give a column an index of its own, of its values and the rows that have them,
+        /// for queries with WHERE comparisons or ORDER BY on the column
+        /// Writing to the column costs a bit more after that
+        /// </summary>
+        /// <param name="table">Table of the column, which must exist</param>
+        /// <param name="column">Name of the column, which must exist</param>
+        void createIndex(const std::wstring& table, const std::wstring& column);
+
+        /// <summary>
+        /// Drop a column's index, if it has one
+        /// </summary>
+        /// <param name="table">Table of the column</param>
+        /// <param name="column">Name of the column</param>
+        void dropIndex(const std::wstring& table, const std::wstring& column);
+
         /// <summary>
         /// Get a snapshot of the virtual schema
         /// </summary>
@@ -154,6 +327,24 @@ namespace fourdb
         /// <returns>Object with table and column names</returns>
         virtualschema getSchema(const std::wstring& table = L"");
 
+        /// <summary>
+        /// How well is the value ID cache that define uses doing?
+        /// </summary>
+        struct valuecachestats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t size = 0;
+            size_t capacity = 0;
+        };
+        valuecachestats getValueCacheStats();
+
+        /// <summary>
+        /// Set how many column values define keeps the database IDs of between calls
+        /// NOTE: Value IDs only go away with reset and compact, so the cache is cleared there
+        /// </summary>
+        void setValueCacheCapacity(size_t capacity);
+
         /// <summary>
         /// Okay, so there are 6 things...but you really don't need this one! 
         /// </summary>
@@ -165,7 +356,62 @@ namespace fourdb
     private:
         static void runSchemaSql(fourdb::db& db, const wchar_t** queries);
 
+        std::shared_ptr<fourdb::db> getReadDb();
+
+        // The table from the catalog, for key lookups that skip the query compiler
+        static std::optional<tables::table_obj> getTableObj(fourdb::db& db, const std::wstring& tableName);
+
+        // generateSql, through the compiled query cache
+        std::wstring getQuerySql(fourdb::db& db, const select& query);
+
+        // Write implementations, callers hold m_writeMutex
+        void defineNoLock(const std::wstring& table, const std::unordered_map<strnum, paramap>& keysToColumnData, const std::function<void(const wchar_t*)>& pacifier, bool inTransaction);
+        void undefineNoLock(const std::wstring& table, const strnum& key, const std::wstring& name);
+        void deleteRowsNoLock(const std::wstring& table, const std::vector<strnum>& keys, bool inTransaction);
+        void defineRows(int tableId, const std::vector<std::pair<const strnum*, const paramap*>>& rows);
+
+        int64_t compactNoLock(std::chrono::steady_clock::time_point deadline, bool& finished);
+        int64_t getFreeBytes();
+
+        void onRollback();
+
+        std::shared_ptr<writequeue> getWriteQueue();
+        std::shared_ptr<writequeue> newWriteQueue(std::chrono::milliseconds window);
+
 	private:
 		std::shared_ptr<fourdb::db> m_db;
+        std::shared_ptr<dbpool> m_readPool; // null unless pooledReads
+        std::shared_ptr<catalog> m_catalog; // shared by m_db and m_readPool
+
+        std::mutex m_writeMutex;
+
+        std::mutex m_writeQueueMutex;
+        std::shared_ptr<writequeue> m_writeQueue; // null until started
+
+        // PRAGMA user_version of databases with all of the upgradeSql schema, bump it when adding to upgradeSql or values::upgradeText
+        static const int SCHEMA_VERSION = 2;
+
+        // how long the writer waits on another connection's lock before giving up with SQLITE_BUSY
+        static const int BUSY_TIMEOUT_MS = 5000;
+
+        // rows per batch of value ID resolution in define
+        static const size_t DEFINE_CHUNK_SIZE = 10000;
+
+        // column value => bvalues ID, guarded by m_writeMutex
+        lrucache<strnum, int64_t> m_valueIdCache;
+        static const size_t DEFAULT_VALUE_CACHE_CAPACITY = 100000;
+
+        // PRAGMA data_version when the cache was last good, other connections' commits change it
+        int64_t m_valueCacheDataVersion = -1;
+
+        // where incremental compact left off, guarded by m_writeMutex
+        int64_t m_compactAfterId = 0;
+        static const int64_t COMPACT_ID_RANGE = 1000;
+
+        // query key + schema version => generated SQL
+        // the prepared statements are cached by the connections, keyed by this SQL
+        std::mutex m_compiledQueriesMutex;
+        lrucache<std::wstring, std::wstring> m_compiledQueries;
+        static const size_t COMPILED_QUERY_CACHE_CAPACITY = 1000;
 	};
 }
@@ -3,16 +3,31 @@
 
 namespace fourdb
 {
-    db::db(const std::string& filePath)
+    db::db(const std::string& filePath, bool readOnly)
         : m_db(nullptr)
+        , m_stmtCache
+        (
+            MAX_CACHED_STATEMENTS, 
+            [](const std::wstring&, std::shared_ptr<cachedstmt>& cached)
+            {
+                if (cached->inUse) // still being read from, leave it be
+                    return false;
+
+                sqlite3_finalize(cached->stmt);
+                return true;
+            }
+        )
     {
-        int rc = sqlite3_open(filePath.c_str(), &m_db);
+        int flags = readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        int rc = sqlite3_open_v2(filePath.c_str(), &m_db, flags, nullptr);
         if (rc != SQLITE_OK)
             throw fourdberr(rc, m_db);
     }
 
     db::~db()
     {
+        clearStatementCache();
+
         if (m_db != nullptr)
         {
             int rc = sqlite3_close(m_db);
@@ -23,8 +38,8 @@ namespace fourdb
 
     std::shared_ptr<dbreader> db::execReader(const std::wstring& sql, const paramap& params)
     {
-        std::wstring fullSql = applyParams(sql, params);
-        auto reader = std::make_shared<dbreader>(m_db, fullSql);
+        auto reader = getReader(sql);
+        bindParams(reader->m_stmt, params);
         return reader;
     }
 
@@ -38,7 +53,7 @@ namespace fourdb
                 ++rowCount;
             }
         }
-        return rowCount > 0 ? rowCount : execScalarInt32(L"SELECT changes()").value();
+        return rowCount > 0 ? rowCount : sqlite3_changes(m_db);
     }
 
     std::optional<int> db::execScalarInt32(const std::wstring& sql, const paramap& params)
@@ -71,14 +86,72 @@ namespace fourdb
     int64_t db::execInsert(const std::wstring& sql, const paramap& params)
     {
         execSql(sql, params);
-        return execScalarInt64(L"select last_insert_rowid()").value();
+        return sqlite3_last_insert_rowid(m_db);
+    }
+
+    void db::clearStatementCache()
+    {
+        std::lock_guard<std::mutex> lock(m_stmtMutex);
+        m_stmtCache.clear();
+    }
+
+    std::shared_ptr<dbreader> db::getReader(const std::wstring& sql)
+    {
+        std::lock_guard<std::mutex> lock(m_stmtMutex);
+
+        std::shared_ptr<cachedstmt> cached;
+        if (m_stmtCache.tryGet(sql, cached))
+        {
+            // The cached statement is busy, like a lookup issued
+            // while reading the results of the same query,
+            // so fall back to a one-off statement
+            if (cached->inUse)
+                return std::make_shared<dbreader>(m_db, sql);
+
+            cached->inUse = true;
+            return std::make_shared<dbreader>(m_db, cached->stmt, &cached->inUse);
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        int rc = sqlite3_prepare_v3(m_db, toNarrowStr(sql).c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+        if (rc != SQLITE_OK)
+            throw fourdberr(rc, m_db);
+
+        // In use before it goes in, so making room can't evict it
+        cached = std::make_shared<cachedstmt>();
+        cached->stmt = stmt;
+        cached->inUse = true;
+        m_stmtCache.put(sql, cached);
+        return std::make_shared<dbreader>(m_db, stmt, &cached->inUse);
     }
 
-    std::wstring db::applyParams(const std::wstring& sql, const paramap& params)
+    void db::bindParams(sqlite3_stmt* stmt, const paramap& params)
     {
-        std::wstring retVal = sql;
         for (const auto& it : params)
-            replace(retVal, it.first, it.second.toSqlLiteral());
-        return retVal;
+        {
+            int idx = sqlite3_bind_parameter_index(stmt, toNarrowStr(it.first).c_str());
+            if (idx == 0)
+                continue; // not used by this statement
+
+            int rc;
+            const strnum& value = it.second;
+            if (value.isStr())
+            {
+                const std::string& str = value.utf8();
+                rc = sqlite3_bind_text(stmt, idx, str.c_str(), static_cast<int>(str.size()), SQLITE_TRANSIENT);
+            }
+            else
+            {
+                // Whole numbers go in as integers, just like the SQL literals used to
+                double num = value.num();
+                if (std::abs(num) < 9.0e18 && num == std::trunc(num))
+                    rc = sqlite3_bind_int64(stmt, idx, static_cast<int64_t>(num));
+                else
+                    rc = sqlite3_bind_double(stmt, idx, num);
+            }
+
+            if (rc != SQLITE_OK)
+                throw fourdberr(rc, m_db);
+        }
     }
 }
@@ -5,9 +5,12 @@
 #include "vectormap.h"
 
 #include "dbreader.h"
+#include "lrucache.h"
 
 namespace fourdb
 {
+    class catalog;
+
     /// <summary>
     /// Shorthand for a string-name-to-strnum-value query parameters map
     /// </summary>
@@ -19,7 +22,7 @@ namespace fourdb
     class db
 	{
 	public:
-        db(const std::string& filePath);
+        db(const std::string& filePath, bool readOnly = false);
         ~db();
 
         /// <summary>
@@ -43,10 +46,41 @@ namespace fourdb
 
         int64_t execInsert(const std::wstring& sql, const paramap& params = paramap());
 
+        /// <summary>
+        /// Finalize the cached prepared statements not being read from
+        /// </summary>
+        void clearStatementCache();
+
+        /// <summary>
+        /// The schema catalog shared by the connections to this database, if any
+        /// </summary>
+        catalog* getCatalog() const
+        {
+            return m_catalog.get();
+        }
+
+        void setCatalog(std::shared_ptr<catalog> schemaCatalog)
+        {
+            m_catalog = schemaCatalog;
+        }
+
     private:
-        static std::wstring applyParams(const std::wstring& sql, const paramap& params);
+        struct cachedstmt
+        {
+            sqlite3_stmt* stmt = nullptr;
+            std::atomic<bool> inUse = false;
+        };
+
+        std::shared_ptr<dbreader> getReader(const std::wstring& sql);
+        void bindParams(sqlite3_stmt* stmt, const paramap& params);
 
     private:
         sqlite3* m_db;
+        std::shared_ptr<catalog> m_catalog;
+
+        // parameterized SQL => prepared statement, statements being read from are never evicted
+        std::mutex m_stmtMutex;
+        lrucache<std::wstring, std::shared_ptr<cachedstmt>> m_stmtCache;
+        static const size_t MAX_CACHED_STATEMENTS = 256;
     };
 }
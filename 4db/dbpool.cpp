@@ -0,0 +1,41 @@
+#include "pch.h"
+#include "dbpool.h"
+
+namespace fourdb
+{
+    dbpool::dbpool(const std::string& filePath, size_t maxIdle, std::shared_ptr<catalog> schemaCatalog)
+        : m_filePath(filePath)
+        , m_catalog(schemaCatalog)
+        , m_state(std::make_shared<poolstate>())
+    {
+        m_state->maxIdle = maxIdle > 0 ? maxIdle : 1;
+    }
+
+    std::shared_ptr<db> dbpool::lease()
+    {
+        std::unique_ptr<db> conn;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (!m_state->idle.empty())
+            {
+                conn = std::move(m_state->idle.back());
+                m_state->idle.pop_back();
+            }
+        }
+
+        if (!conn)
+        {
+            conn = std::make_unique<db>(m_filePath, true);
+            conn->setCatalog(m_catalog);
+        }
+
+        std::shared_ptr<poolstate> state = m_state;
+        return std::shared_ptr<db>(conn.release(), [state](db* returned)
+        {
+            std::unique_ptr<db> toReturn(returned);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->idle.size() < state->maxIdle)
+                state->idle.push_back(std::move(toReturn));
+        });
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "db.h"
+
+namespace fourdb
+{
+    /// <summary>
+    /// Pool of read-only connections to one database file
+    /// Meant for WAL databases, where readers do not block each other or the writer
+    /// </summary>
+    class dbpool
+    {
+    public:
+        /// <summary>
+        /// Set up a pool that keeps up to maxIdle connections around between leases
+        /// Connections share the given schema catalog, if any
+        /// </summary>
+        dbpool(const std::string& filePath, size_t maxIdle, std::shared_ptr<catalog> schemaCatalog = nullptr);
+
+        /// <summary>
+        /// Get a connection for the exclusive use of the caller
+        /// It goes back into the pool when the last copy of the pointer is released
+        /// If all pooled connections are leased out, a new one is opened
+        /// </summary>
+        std::shared_ptr<db> lease();
+
+    private:
+        // Shared with outstanding leases so they can find their way home
+        struct poolstate
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<db>> idle;
+            size_t maxIdle = 0;
+        };
+
+        std::string m_filePath;
+        std::shared_ptr<catalog> m_catalog;
+        std::shared_ptr<poolstate> m_state;
+    };
+}
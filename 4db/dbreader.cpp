@@ -6,6 +6,7 @@ namespace fourdb
     dbreader::dbreader(sqlite3* db, const std::wstring& sql)
         : m_db(db)
         , m_stmt(nullptr)
+        , m_inUse(nullptr)
         , m_doneReading(false)
     {
         int rc = sqlite3_prepare_v3(m_db, toNarrowStr(sql).c_str(), -1, 0, &m_stmt, nullptr);
@@ -13,9 +14,24 @@ namespace fourdb
             throw fourdberr(rc, db);
     }
 
+    dbreader::dbreader(sqlite3* db, sqlite3_stmt* stmt, std::atomic<bool>* inUse)
+        : m_db(db)
+        , m_stmt(stmt)
+        , m_inUse(inUse)
+        , m_doneReading(false)
+    {
+    }
+
     dbreader::~dbreader()
     {
-        sqlite3_finalize(m_stmt);
+        if (m_inUse != nullptr)
+        {
+            sqlite3_reset(m_stmt);
+            sqlite3_clear_bindings(m_stmt);
+            *m_inUse = false;
+        }
+        else
+            sqlite3_finalize(m_stmt);
     }
 
     bool dbreader::read()
@@ -44,7 +60,22 @@ namespace fourdb
 
     std::wstring dbreader::getColName(unsigned idx)
     {
-        return toWideStr(sqlite3_column_name(m_stmt, idx));
+        if (m_colNames.empty())
+        {
+            unsigned colCount = getColCount();
+            m_colNames.reserve(colCount);
+            for (unsigned c = 0; c < colCount; ++c)
+                m_colNames.push_back(toWideStr(sqlite3_column_name(m_stmt, c)));
+        }
+        return m_colNames.at(idx);
+    }
+
+    std::string_view dbreader::getColNameUtf8(unsigned idx)
+    {
+        const char* name = sqlite3_column_name(m_stmt, idx);
+        if (name == nullptr)
+            throw fourdberr("Invalid column index: " + std::to_string(idx));
+        return name;
     }
 
     std::wstring dbreader::getString(unsigned idx)
@@ -69,6 +100,15 @@ namespace fourdb
         }
     }
 
+    std::string_view dbreader::getStringUtf8(unsigned idx)
+    {
+        // Text first, then bytes, per the SQLite docs
+        auto str = reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, idx));
+        if (str == nullptr)
+            return std::string_view();
+        return std::string_view(str, static_cast<size_t>(sqlite3_column_bytes(m_stmt, idx)));
+    }
+
     double dbreader::getDouble(unsigned idx)
     {
         return sqlite3_column_double(m_stmt, idx);
@@ -102,13 +142,13 @@ namespace fourdb
             return sqlite3_column_double(m_stmt, idx);
         case SQLITE_NULL:
             isNull = true;
-            return toWideStr("null");
+            return std::string("null");
         case SQLITE_BLOB:
-            return toWideStr("blob");
+            return std::string("blob");
         default:
-            auto str = sqlite3_column_text(m_stmt, idx);
-            if (str != nullptr)
-                return toWideStr(str);
+            auto str = getStringUtf8(idx);
+            if (str.data() != nullptr)
+                return std::string(str);
             else
                 throw fourdberr("Unknown column type: " + std::to_string(columnType));
         }
@@ -14,14 +14,24 @@ namespace fourdb
     public:
         // Called by db, not meant to be called elsewhere
         dbreader(sqlite3* db, const std::wstring& sql);
+
+        // Called by db for cached statements
+        // the statement is reset instead of finalized when this is done with it
+        dbreader(sqlite3* db, sqlite3_stmt* stmt, std::atomic<bool>* inUse);
         ~dbreader();
 
         bool read();
 
         unsigned getColCount();
-        std::wstring getColName(unsigned idx);
+        std::wstring getColName(unsigned idx); // converted once per reader
+        std::string_view getColNameUtf8(unsigned idx); // good for the life of the reader
 
         std::wstring getString(unsigned idx); // best-effort string conversion
+
+        // UTF-8 straight out of SQLite, no conversion or copying
+        // NOTE: only good until the next read(), copy it if you need it longer
+        //       numbers come back as SQLite formats them, null as an empty string
+        std::string_view getStringUtf8(unsigned idx);
         
         double getDouble(unsigned idx);
         
@@ -35,8 +45,12 @@ namespace fourdb
         bool isNull(unsigned idx);
 
     private:
+        friend class db;
+
         sqlite3* m_db;
         sqlite3_stmt* m_stmt;
+        std::atomic<bool>* m_inUse; // non-null for cached statements
         bool m_doneReading;
+        std::vector<std::wstring> m_colNames; // empty until getColName
     };
 }
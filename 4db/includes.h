@@ -1,20 +1,42 @@
 // Include this file in your PCH, you'll sleep better at night...
 #pragma once
 
+#if __has_include("../../sqlite/sqlite3.h")
 #include "../../sqlite/sqlite3.h"
+#else
+#include <sqlite3.h> // system SQLite, see CMakeLists.txt
+#endif
 
 #include <assert.h>
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <bit>
+#include <cmath>
+#include <chrono>
 #include <codecvt>
+#include <condition_variable>
+#include <cstring>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <list>
 #include <locale> 
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+
+#ifndef _WIN32
+#include <wchar.h>
+#define _wcsicmp wcscasecmp
+#define _wtoi(str) static_cast<int>(wcstol((str), nullptr, 10))
+#endif
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "items.h"
 
+#include "catalog.h"
+#include "values.h"
+
 namespace fourdb
 {
     const wchar_t** items::createSql()
@@ -47,8 +50,35 @@ namespace fourdb
         return sql;
     }
 
+    const wchar_t** items::upgradeSql()
+    {
+        static const wchar_t* sql[] =
+        {
+            // For finding rows by column value, see sql::generateSql
+            L"CREATE INDEX IF NOT EXISTS idx_itemnamevalues_nameid_valueid ON itemnamevalues (nameid, valueid, itemid)",
+
+            // For going through the rows of one table, and counting them
+            L"CREATE INDEX IF NOT EXISTS idx_items_tableid ON items (tableid)",
+
+            // The columns with indexes of their own, see addColumnIndex
+            L"CREATE TABLE IF NOT EXISTS indexcolumns\n(\n"
+            L"tableid INTEGER NOT NULL,\n"
+            L"nameid INTEGER NOT NULL,\n"
+            L"PRIMARY KEY (tableid, nameid)\n"
+            L")",
+
+            nullptr
+        };
+        return sql;
+    }
+
     void items::reset(db& db)
     {
+        // Drop the column indexes first so their triggers don't have to keep up
+        for (const auto& indexColumn : getIndexColumns(db))
+            removeColumnIndex(db, indexColumn.first, indexColumn.second);
+
+        db.execSql(L"DELETE FROM itemnamevalues");
         db.execSql(L"DELETE FROM items");
     }
 
@@ -60,41 +90,143 @@ namespace fourdb
             { L"@valueId", static_cast<double>(valueId) }
         };
 
-        {
-            std::wstring selectSql =
-                L"SELECT id FROM items WHERE tableId = @tableId AND valueId = @valueId";
-            int64_t id = db.execScalarInt64(selectSql, params).value_or(-1);
-            if (id >= 0)
-                return id;
-        }
-
-        if (noCreate)
-            return -1;
-
+        // Add it if it's not there, one statement for new items
+        if (!noCreate)
         {
             std::wstring insertSql =
                 L"INSERT INTO items (tableid, valueid, created, lastmodified) "
-                L"VALUES (@tableId, @valueId, DATETIME('now'), DATETIME('now'))";
-            int64_t id = db.execInsert(insertSql, params);
-            return id;
+                L"VALUES (@tableId, @valueId, DATETIME('now'), DATETIME('now')) "
+                L"ON CONFLICT(valueid, tableid) DO NOTHING "
+                L"RETURNING id";
+            auto id = db.execScalarInt64(insertSql, params);
+            if (id.has_value())
+                return id.value();
         }
+
+        std::wstring selectSql =
+            L"SELECT id FROM items WHERE tableId = @tableId AND valueId = @valueId";
+        return db.execScalarInt64(selectSql, params).value_or(-1);
     }
 
     std::unordered_map<int, int64_t> items::getItemData(db& db, int64_t itemId)
     {
         std::unordered_map<int, int64_t> retVal;
-        std::wstring sql = L"SELECT nameid, valueid FROM itemnamevalues WHERE itemid = " + std::to_wstring(itemId);
-        auto reader = db.execReader(sql);
+        paramap params{ { L"@itemId", static_cast<double>(itemId) } };
+        std::wstring sql = L"SELECT nameid, valueid FROM itemnamevalues WHERE itemid = @itemId";
+        auto reader = db.execReader(sql, params);
         while (reader->read())
             retVal[reader->getInt32(0)] = reader->getInt64(1);
         return retVal;
     }
 
+    void items::getItemsValues
+    (
+        db& db, 
+        const std::vector<int64_t>& itemIds, 
+        const std::vector<int>& nameIds, 
+        const std::function<void(size_t, int, strnum&&)>& onValue
+    )
+    {
+        if (itemIds.empty())
+            return;
+
+        // Name IDs are numbers, so they can go right in
+        std::wstring namesSql;
+        for (int nameId : nameIds)
+            namesSql += (namesSql.empty() ? L"" : L", ") + std::to_wstring(nameId);
+        if (!namesSql.empty())
+            namesSql = L" AND inv.nameid IN (" + namesSql + L")";
+
+        auto readValues = [&](const std::shared_ptr<dbreader>& reader, size_t fixedIdx)
+        {
+            while (reader->read())
+            {
+                size_t idx = fixedIdx != SIZE_MAX ? fixedIdx : static_cast<size_t>(reader->getInt64(4));
+                if (reader->getBoolean(1))
+                    onValue(idx, reader->getInt32(0), strnum(reader->getDouble(2)));
+                else
+                    onValue(idx, reader->getInt32(0), strnum(std::string(reader->getStringUtf8(3))));
+            }
+        };
+
+        if (itemIds.size() < values::MIN_BATCH_SIZE)
+        {
+            std::wstring sql =
+                L"SELECT inv.nameid, v.isNumeric, v.numberValue, v.stringValue "
+                L"FROM itemnamevalues AS inv JOIN bvalues AS v ON v.id = inv.valueid "
+                L"WHERE inv.itemid = @itemId" + namesSql;
+            for (size_t idx = 0; idx < itemIds.size(); ++idx)
+            {
+                paramap params{ { L"@itemId", static_cast<double>(itemIds[idx]) } };
+                readValues(db.execReader(sql, params), idx);
+            }
+            return;
+        }
+
+        loadRowIdBatch(db, itemIds);
+        readValues
+        (
+            db.execReader
+            (
+                L"SELECT inv.nameid, v.isNumeric, v.numberValue, v.stringValue, rb.idx "
+                L"FROM temp.rowidbatch AS rb "
+                L"CROSS JOIN itemnamevalues AS inv ON inv.itemid = rb.id" + namesSql + L" "
+                L"JOIN bvalues AS v ON v.id = inv.valueid"
+            ), 
+            SIZE_MAX
+        );
+        db.execSql(L"DELETE FROM temp.rowidbatch");
+    }
+
+    void items::getItemsTimes
+    (
+        db& db, 
+        const std::vector<int64_t>& itemIds, 
+        const std::function<void(size_t, strnum&&, strnum&&)>& onTimes
+    )
+    {
+        if (itemIds.empty())
+            return;
+
+        auto readTimes = [&](const std::shared_ptr<dbreader>& reader, size_t fixedIdx)
+        {
+            while (reader->read())
+            {
+                size_t idx = fixedIdx != SIZE_MAX ? fixedIdx : static_cast<size_t>(reader->getInt64(2));
+                onTimes(idx, strnum(reader->getString(0)), strnum(reader->getString(1)));
+            }
+        };
+
+        if (itemIds.size() < values::MIN_BATCH_SIZE)
+        {
+            for (size_t idx = 0; idx < itemIds.size(); ++idx)
+            {
+                paramap params{ { L"@itemId", static_cast<double>(itemIds[idx]) } };
+                readTimes(db.execReader(L"SELECT created, lastmodified FROM items WHERE id = @itemId", params), idx);
+            }
+            return;
+        }
+
+        loadRowIdBatch(db, itemIds);
+        readTimes
+        (
+            db.execReader
+            (
+                L"SELECT i.created, i.lastmodified, rb.idx "
+                L"FROM temp.rowidbatch AS rb "
+                L"CROSS JOIN items AS i ON i.id = rb.id"
+            ), 
+            SIZE_MAX
+        );
+        db.execSql(L"DELETE FROM temp.rowidbatch");
+    }
+
     void items::setItemData(db& db, int64_t itemId, const std::unordered_map<int, int64_t>& metadata)
     {
+        paramap updateParams{ { L"@itemId", static_cast<double>(itemId) } };
         std::wstring updateSql =
-            L"UPDATE items SET lastmodified = DATETIME('now') WHERE id = " + std::to_wstring(itemId);
-        db.execSql(updateSql);
+            L"UPDATE items SET lastmodified = DATETIME('now') WHERE id = @itemId";
+        db.execSql(updateSql, updateParams);
 
         for (auto it : metadata)
         {
@@ -116,53 +248,301 @@ namespace fourdb
         }
     }
 
-    std::vector<std::wstring> items::setItemDataSql(int64_t itemId, const std::unordered_map<int, int64_t>& metadata)
+    void items::removeItemData(db& db, int64_t itemId, int nameId)
+    {
+        paramap params
+        {
+            { L"@itemId", static_cast<double>(itemId) },
+            { L"@nameId", static_cast<double>(nameId) }
+        };
+
+        std::wstring updateSql =
+            L"UPDATE items SET lastmodified = DATETIME('now') WHERE id = @itemId";
+        db.execSql(updateSql, params);
+
+        std::wstring sql = L"DELETE FROM itemnamevalues WHERE itemid = @itemId AND nameid = @nameId";
+        db.execSql(sql, params);
+    }
+
+    void items::deleteItem(db& db, int64_t itemId)
+    {
+        paramap params{ { L"@itemId", static_cast<double>(itemId) } };
+        db.execSql(L"DELETE FROM itemnamevalues WHERE itemid = @itemId", params);
+        db.execSql(L"DELETE FROM items WHERE id = @itemId", params);
+    }
+
+    int items::deleteItems(db& db, int tableId, const std::vector<strnum>& keys)
+    {
+        if (keys.empty())
+            return 0;
+
+        values::loadValueBatch(db, keys);
+
+        db.execSql(L"CREATE TEMP TABLE IF NOT EXISTS itembatch (id INTEGER PRIMARY KEY NOT NULL)");
+        db.execSql(L"DELETE FROM temp.itembatch");
+
+        // CROSS JOIN so the keys drive it, see getRowIds
+        paramap params{ { L"@tableId", tableId } };
+        db.execSql
+        (
+            L"INSERT OR IGNORE INTO temp.itembatch (id) "
+            L"SELECT i.id "
+            L"FROM temp.valuebatch AS vb "
+            L"CROSS JOIN bvalues AS bv "
+            L"ON bv.stringValue = vb.stringValue AND bv.numberValue = vb.numberValue AND bv.isNumeric = vb.isNumeric "
+            L"CROSS JOIN items AS i ON i.valueid = bv.id AND i.tableid = @tableId",
+            params
+        );
+
+        db.execSql(L"DELETE FROM itemnamevalues WHERE itemid IN (SELECT id FROM temp.itembatch)");
+        int deleted = db.execSql(L"DELETE FROM items WHERE id IN (SELECT id FROM temp.itembatch)");
+
+        db.execSql(L"DELETE FROM temp.itembatch");
+        db.execSql(L"DELETE FROM temp.valuebatch");
+        return deleted;
+    }
+
+    void items::ensureValueIndex(db& db)
     {
-        std::vector<std::wstring> retVal;
-        if (metadata.empty())
+        db.execSql(L"CREATE INDEX IF NOT EXISTS idx_itemnamevalues_valueid ON itemnamevalues (valueid)");
+    }
+
+    int64_t items::getRowId(db& db, int tableId, bool isNumeric, const strnum& key)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@value", key } };
+        std::wstring sql =
+            isNumeric
+            ? L"SELECT i.id FROM bvalues AS v JOIN items AS i ON i.valueid = v.id AND i.tableid = @tableId "
+              L"WHERE v.isNumeric = 1 AND v.numberValue = @value"
+            : L"SELECT i.id FROM bvalues AS v JOIN items AS i ON i.valueid = v.id AND i.tableid = @tableId "
+              L"WHERE v.isNumeric = 0 AND v.stringValue = @value";
+        return db.execScalarInt64(sql, params).value_or(-1);
+    }
+
+    std::vector<int64_t> items::getRowIds(db& db, int tableId, bool isNumeric, const std::vector<strnum>& keys)
+    {
+        std::vector<int64_t> retVal(keys.size(), -1);
+        if (keys.size() < values::MIN_BATCH_SIZE)
+        {
+            for (size_t k = 0; k < keys.size(); ++k)
+                retVal[k] = getRowId(db, tableId, isNumeric, keys[k]);
             return retVal;
+        }
 
-        retVal.reserve(metadata.size() + 1);
+        values::loadValueBatch(db, keys);
 
-        std::wstring updateSql =
-            L"UPDATE items SET lastmodified = DATETIME('now') WHERE id = " + std::to_wstring(itemId);
-        retVal.push_back(updateSql);
+        // CROSS JOIN keeps the batch on the outside, SQLite knows nothing of the size
+        // of temp tables and would otherwise go through every row of the table
+        paramap params{ { L"@tableId", tableId } };
+        auto reader =
+            db.execReader
+            (
+                L"SELECT vb.idx, i.id "
+                L"FROM temp.valuebatch AS vb "
+                L"CROSS JOIN bvalues AS bv "
+                L"ON bv.stringValue = vb.stringValue AND bv.numberValue = vb.numberValue AND bv.isNumeric = vb.isNumeric "
+                L"CROSS JOIN items AS i ON i.valueid = bv.id AND i.tableid = @tableId",
+                params
+            );
+        while (reader->read())
+            retVal[static_cast<size_t>(reader->getInt64(0))] = reader->getInt64(1);
+        reader.reset();
 
-        std::wstring itemIdStr = num2str(static_cast<double>(itemId));
+        db.execSql(L"DELETE FROM temp.valuebatch");
+        return retVal;
+    }
 
-        for (auto it : metadata)
+    std::optional<strnum> items::getRowKey(db& db, int tableId, bool isNumeric, int64_t rowId)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@id", static_cast<double>(rowId) } };
+        auto reader =
+            db.execReader
+            (
+                std::wstring(L"SELECT ") + (isNumeric ? L"v.numberValue" : L"v.stringValue") + L" "
+                L"FROM items AS i JOIN bvalues AS v ON v.id = i.valueid "
+                L"WHERE i.id = @id AND i.tableid = @tableId",
+                params
+            );
+        if (!reader->read())
+            return std::nullopt;
+        else if (isNumeric)
+            return strnum(reader->getDouble(0));
+        else
+            return strnum(std::string(reader->getStringUtf8(0)));
+    }
+
+    std::vector<std::optional<strnum>> items::getRowKeys(db& db, int tableId, bool isNumeric, const std::vector<int64_t>& rowIds)
+    {
+        std::vector<std::optional<strnum>> retVal(rowIds.size());
+        if (rowIds.size() < values::MIN_BATCH_SIZE)
         {
-            std::wstring nameIdStr = num2str(static_cast<double>(it.first));
-            std::wstring valueId = num2str(static_cast<double>(it.second));
+            for (size_t r = 0; r < rowIds.size(); ++r)
+                retVal[r] = getRowKey(db, tableId, isNumeric, rowIds[r]);
+            return retVal;
+        }
 
-            std::wstring sql =
-                L"INSERT INTO itemnamevalues (itemid, nameid, valueid) "
-                L"VALUES (" + itemIdStr + L", " + nameIdStr + L", " + valueId + L") "
-                L"ON CONFLICT(itemid, nameid) "
-                L"DO UPDATE SET valueid = " + valueId;
-            retVal.push_back(sql);
+        loadRowIdBatch(db, rowIds);
+
+        paramap params{ { L"@tableId", tableId } };
+        auto reader =
+            db.execReader
+            (
+                std::wstring(L"SELECT rb.idx, ") + (isNumeric ? L"v.numberValue" : L"v.stringValue") + L" "
+                L"FROM temp.rowidbatch AS rb "
+                L"CROSS JOIN items AS i ON i.id = rb.id AND i.tableid = @tableId "
+                L"JOIN bvalues AS v ON v.id = i.valueid",
+                params
+            );
+        while (reader->read())
+        {
+            size_t idx = static_cast<size_t>(reader->getInt64(0));
+            if (isNumeric)
+                retVal[idx] = strnum(reader->getDouble(1));
+            else
+                retVal[idx] = strnum(std::string(reader->getStringUtf8(1)));
         }
+        reader.reset();
 
+        db.execSql(L"DELETE FROM temp.rowidbatch");
         return retVal;
     }
 
-    void items::removeItemData(db& db, int64_t itemId, int nameId)
+    void items::loadRowIdBatch(db& db, const std::vector<int64_t>& rowIds)
     {
-        std::wstring updateSql =
-            L"UPDATE items SET lastmodified = DATETIME('now') WHERE id = " + std::to_wstring(itemId);
-        db.execSql(updateSql);
+        db.execSql
+        (
+            L"CREATE TEMP TABLE IF NOT EXISTS rowidbatch\n(\n"
+            L"idx INTEGER PRIMARY KEY NOT NULL,\n"
+            L"id INTEGER NOT NULL\n"
+            L")"
+        );
+        db.execSql(L"DELETE FROM temp.rowidbatch");
 
-        paramap params
+        // All in one statement, as a JSON array of the IDs
+        std::string idsJson = "[";
+        for (size_t idx = 0; idx < rowIds.size(); ++idx)
         {
-            { L"@itemId", static_cast<double>(itemId) },
-            { L"@nameId", static_cast<double>(nameId) }
-        };
-        std::wstring sql = L"DELETE FROM itemnamevalues WHERE itemid = @itemId AND nameid = @nameId";
-        db.execSql(sql, params);
+            if (idx > 0)
+                idsJson += ',';
+            idsJson += std::to_string(rowIds[idx]);
+        }
+        idsJson += ']';
+
+        paramap params{ { L"@ids", strnum(std::move(idsJson)) } };
+        db.execSql(L"INSERT INTO temp.rowidbatch (idx, id) SELECT key, value FROM json_each(@ids)", params);
     }
 
-    void items::deleteItem(db& db, int64_t itemId)
+    std::wstring items::getColumnIndexTableName(int tableId, int nameId)
+    {
+        return L"columnindex_" + std::to_wstring(tableId) + L"_" + std::to_wstring(nameId);
+    }
+
+    std::vector<std::pair<int, int>> items::getIndexColumns(db& db)
     {
-        db.execSql(L"DELETE FROM items WHERE id = " + std::to_wstring(itemId));
+        std::vector<std::pair<int, int>> retVal;
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            for (const auto& tableIt : schemaCatalog->current()->indexNameIds)
+            {
+                for (int nameId : tableIt.second)
+                    retVal.push_back({ tableIt.first, nameId });
+            }
+        }
+        else
+        {
+            auto reader = db.execReader(L"SELECT tableid, nameid FROM indexcolumns");
+            while (reader->read())
+                retVal.push_back({ reader->getInt32(0), reader->getInt32(1) });
+        }
+        return retVal;
+    }
+
+    bool items::isColumnIndexed(db& db, int tableId, int nameId)
+    {
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto tableIt = snapshot->indexNameIds.find(tableId);
+            return tableIt != snapshot->indexNameIds.end() && tableIt->second.find(nameId) != tableIt->second.end();
+        }
+
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        return db.execScalarInt32(L"SELECT 1 FROM indexcolumns WHERE tableid = @tableId AND nameid = @nameId", params).has_value();
+    }
+
+    void items::addColumnIndex(db& db, int tableId, int nameId, bool isNumeric)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        int added =
+            db.execSql
+            (
+                L"INSERT INTO indexcolumns (tableid, nameid) VALUES (@tableId, @nameId) "
+                L"ON CONFLICT(tableid, nameid) DO NOTHING",
+                params
+            );
+        if (added == 0)
+            return;
+
+        std::wstring indexTable = getColumnIndexTableName(tableId, nameId);
+        std::wstring nameIdStr = std::to_wstring(nameId);
+        std::wstring valueColumn = isNumeric ? L"numberValue" : L"stringValue";
+
+        // The column's values in order, with the rows that have them
+        db.execSql
+        (
+            L"CREATE TABLE " + indexTable + L"\n(\n"
+            L"value " + (isNumeric ? L"NUMBER" : L"TEXT") + L" NOT NULL,\n"
+            L"itemid INTEGER NOT NULL,\n"
+            L"PRIMARY KEY (value, itemid)\n"
+            L") WITHOUT ROWID"
+        );
+
+        // Kept up by triggers, whichever way the column data gets written
+        std::wstring insertNew =
+            L"INSERT OR IGNORE INTO " + indexTable + L" (value, itemid) "
+            L"SELECT " + valueColumn + L", NEW.itemid FROM bvalues WHERE id = NEW.valueid; ";
+        std::wstring deleteOld =
+            L"DELETE FROM " + indexTable + L" "
+            L"WHERE value = (SELECT " + valueColumn + L" FROM bvalues WHERE id = OLD.valueid) AND itemid = OLD.itemid; ";
+
+        db.execSql
+        (
+            L"CREATE TRIGGER " + indexTable + L"_insert AFTER INSERT ON itemnamevalues "
+            L"WHEN NEW.nameid = " + nameIdStr + L" BEGIN " + insertNew + L"END"
+        );
+        db.execSql
+        (
+            L"CREATE TRIGGER " + indexTable + L"_update AFTER UPDATE OF valueid ON itemnamevalues "
+            L"WHEN NEW.nameid = " + nameIdStr + L" BEGIN " + deleteOld + insertNew + L"END"
+        );
+        db.execSql
+        (
+            L"CREATE TRIGGER " + indexTable + L"_delete AFTER DELETE ON itemnamevalues "
+            L"WHEN OLD.nameid = " + nameIdStr + L" BEGIN " + deleteOld + L"END"
+        );
+
+        // Index what's there already
+        db.execSql
+        (
+            L"INSERT INTO " + indexTable + L" (value, itemid) "
+            L"SELECT v." + valueColumn + L", inv.itemid FROM itemnamevalues AS inv "
+            L"JOIN bvalues AS v ON v.id = inv.valueid "
+            L"WHERE inv.nameid = @nameId",
+            params
+        );
+    }
+
+    void items::removeColumnIndex(db& db, int tableId, int nameId)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        db.execSql(L"DELETE FROM indexcolumns WHERE tableid = @tableId AND nameid = @nameId", params);
+
+        std::wstring indexTable = getColumnIndexTableName(tableId, nameId);
+        db.execSql(L"DROP TRIGGER IF EXISTS " + indexTable + L"_insert");
+        db.execSql(L"DROP TRIGGER IF EXISTS " + indexTable + L"_update");
+        db.execSql(L"DROP TRIGGER IF EXISTS " + indexTable + L"_delete");
+        db.execSql(L"DROP TABLE IF EXISTS " + indexTable);
     }
 }
@@ -12,16 +12,111 @@ namespace fourdb
     public:
         static const wchar_t** createSql();
 
+        /// <summary>
+        /// Schema added since databases were first being created, run when opening one from before it,
+        /// see ctxt::SCHEMA_VERSION
+        /// </summary>
+        static const wchar_t** upgradeSql();
+
         static void reset(db& db);
 
         static int64_t getId(db& db, int tableId, int64_t valueId, bool noCreate = false);
         static std::unordered_map<int, int64_t> getItemData(db& db, int64_t itemId);
 
+        /// <summary>
+        /// Get the column values of items in one query, calling onValue with
+        /// the index of the item, the name ID, and the value
+        /// </summary>
+        /// <param name="nameIds">The names to get, all of them if empty</param>
+        static void getItemsValues
+        (
+            db& db, 
+            const std::vector<int64_t>& itemIds, 
+            const std::vector<int>& nameIds, 
+            const std::function<void(size_t, int, strnum&&)>& onValue
+        );
+
+        /// <summary>
+        /// Get the created and lastmodified times of items in one query, calling onTimes with
+        /// the index of the item and its times
+        /// </summary>
+        static void getItemsTimes
+        (
+            db& db, 
+            const std::vector<int64_t>& itemIds, 
+            const std::function<void(size_t, strnum&&, strnum&&)>& onTimes
+        );
+
         static void setItemData(db& db, int64_t itemId, const std::unordered_map<int, int64_t>& metadata);
-        static std::vector<std::wstring> setItemDataSql(int64_t itemId, const std::unordered_map<int, int64_t>& metadata);
         
         static void removeItemData(db& db, int64_t itemId, int nameId);
 
         static void deleteItem(db& db, int64_t itemId);
+
+        /// <summary>
+        /// Delete the items with the given primary keys from a table, along with their data
+        /// Keys are matched up in one query, keys not in the table are skipped
+        /// Best run inside a transaction
+        /// </summary>
+        /// <returns>How many items were deleted</returns>
+        static int deleteItems(db& db, int tableId, const std::vector<strnum>& keys);
+
+        /// <summary>
+        /// Index the column data by value, for finding out if values are still in use
+        /// Only compacting needs this, so it's added then, not with the rest of the schema
+        /// </summary>
+        static void ensureValueIndex(db& db);
+
+        /// <summary>
+        /// Find the row with a primary key, right from the items and bvalues indexes
+        /// </summary>
+        /// <returns>Row ID, or -1 if not found</returns>
+        static int64_t getRowId(db& db, int tableId, bool isNumeric, const strnum& key);
+
+        /// <summary>
+        /// Find the rows with primary keys in one query
+        /// </summary>
+        /// <returns>Row IDs in the order of the keys, -1 for those not found</returns>
+        static std::vector<int64_t> getRowIds(db& db, int tableId, bool isNumeric, const std::vector<strnum>& keys);
+
+        /// <summary>
+        /// Get the primary key of a row
+        /// </summary>
+        static std::optional<strnum> getRowKey(db& db, int tableId, bool isNumeric, int64_t rowId);
+
+        /// <summary>
+        /// Get the primary keys of rows in one query
+        /// </summary>
+        /// <returns>Keys in the order of the row IDs, std::nullopt for those not found</returns>
+        static std::vector<std::optional<strnum>> getRowKeys(db& db, int tableId, bool isNumeric, const std::vector<int64_t>& rowIds);
+
+        /// <summary>
+        /// A column index is a table of a column's values and the rows that have them,
+        /// kept up by triggers on itemnamevalues, so only the indexed columns pay for them
+        /// </summary>
+        static std::wstring getColumnIndexTableName(int tableId, int nameId);
+
+        /// <summary>
+        /// Get the (table ID, name ID) of the indexed columns
+        /// </summary>
+        static std::vector<std::pair<int, int>> getIndexColumns(db& db);
+
+        static bool isColumnIndexed(db& db, int tableId, int nameId);
+
+        /// <summary>
+        /// Index a column, indexing what's there already
+        /// Reload the catalog afterwards
+        /// </summary>
+        static void addColumnIndex(db& db, int tableId, int nameId, bool isNumeric);
+
+        /// <summary>
+        /// Drop a column's index
+        /// Reload the catalog afterwards
+        /// </summary>
+        static void removeColumnIndex(db& db, int tableId, int nameId);
+
+    private:
+        // Load row IDs into temp.rowidbatch (idx, id) for joining against items, clearing out what was there
+        static void loadRowIdBatch(db& db, const std::vector<int64_t>& rowIds);
     };
 }
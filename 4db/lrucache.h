@@ -0,0 +1,158 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+namespace fourdb
+{
+    /// <summary>
+    /// An lrucache is a size-bounded map that drops the least recently used 
+    /// key-value pair when it is full and a new pair is added
+    /// It keeps count of lookup hits and misses so you can tell if it's earning its keep
+    /// An eviction hook gets the last word on each pair being dropped, returning false keeps it
+    /// NOTE: Not thread-safe, callers do their own locking
+    /// </summary>
+    /// <typeparam name="K">Key type of the cache</typeparam>
+    /// <typeparam name="V">Value type of the cache</typeparam>
+    template <typename K, typename V>
+    class lrucache
+    {
+    public:
+        using evicthook = std::function<bool(const K&, V&)>;
+
+        lrucache(size_t capacity, evicthook onEvict = nullptr)
+            : m_capacity(capacity > 0 ? capacity : 1)
+            , m_hits(0)
+            , m_misses(0)
+            , m_onEvict(onEvict)
+        {}
+
+        /// <summary>
+        /// Get a value, counting the hit or miss
+        /// A hit makes the pair the most recently used
+        /// </summary>
+        /// <param name="key">Key value to look up</param>
+        /// <param name="val">Value to populate</param>
+        /// <returns>true if a value exists for the key, false otherwise</returns>
+        bool tryGet(const K& key, V& val)
+        {
+            auto it = m_map.find(key);
+            if (it == m_map.end())
+            {
+                ++m_misses;
+                return false;
+            }
+
+            ++m_hits;
+            m_list.splice(m_list.begin(), m_list, it->second);
+            val = it->second->second;
+            return true;
+        }
+
+        /// <summary>
+        /// Add or update a key-value pair, making it the most recently used
+        /// </summary>
+        void put(const K& key, const V& val)
+        {
+            auto it = m_map.find(key);
+            if (it != m_map.end())
+            {
+                it->second->second = val;
+                m_list.splice(m_list.begin(), m_list, it->second);
+                return;
+            }
+
+            m_list.emplace_front(key, val);
+            m_map.insert({ key, m_list.begin() });
+            trim();
+        }
+
+        /// <summary>
+        /// Remove all key-value pairs, except those the eviction hook keeps
+        /// NOTE: hit and miss counts are kept
+        /// </summary>
+        void clear()
+        {
+            if (!m_onEvict)
+            {
+                m_map.clear();
+                m_list.clear();
+                return;
+            }
+
+            for (auto it = m_list.begin(); it != m_list.end();)
+            {
+                if (!m_onEvict(it->first, it->second))
+                {
+                    ++it;
+                    continue;
+                }
+
+                m_map.erase(it->first);
+                it = m_list.erase(it);
+            }
+        }
+
+        /// <summary>
+        /// How many key-value pairs are in this?
+        /// </summary>
+        size_t size() const
+        {
+            return m_map.size();
+        }
+
+        /// <summary>
+        /// How many key-value pairs can this hold?
+        /// </summary>
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        /// <summary>
+        /// Change how many key-value pairs this can hold, dropping pairs as needed
+        /// </summary>
+        void setCapacity(size_t capacity)
+        {
+            m_capacity = capacity > 0 ? capacity : 1;
+            trim();
+        }
+
+        size_t hits() const
+        {
+            return m_hits;
+        }
+
+        size_t misses() const
+        {
+            return m_misses;
+        }
+
+    private:
+        void trim()
+        {
+            // Least recently used first, stepping over the pairs the hook keeps,
+            // so if it keeps enough of them this stays over capacity for a while
+            auto it = m_list.end();
+            while (m_map.size() > m_capacity && it != m_list.begin())
+            {
+                --it;
+                if (m_onEvict && !m_onEvict(it->first, it->second))
+                    continue;
+
+                m_map.erase(it->first);
+                it = m_list.erase(it);
+            }
+        }
+
+    private:
+        size_t m_capacity;
+        size_t m_hits;
+        size_t m_misses;
+        evicthook m_onEvict;
+
+        std::list<std::pair<K, V>> m_list; // most recently used up front
+        std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator> m_map;
+    };
+}
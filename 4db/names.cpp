@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "names.h"
 
+#include "catalog.h"
+
 namespace fourdb
 {
     const wchar_t** names::createSql()
@@ -23,17 +25,24 @@ namespace fourdb
     void names::reset(db& db)
     {
         db.execSql(L"DELETE FROM names");
-        clearCaches();
+        if (db.getCatalog() != nullptr)
+            db.getCatalog()->clear();
     }
 
     int names::getId(db& db, int tableId, std::wstring name, bool isNumeric, bool noCreate, bool noException)
     {
-        std::lock_guard<std::mutex> lock(getMutex());
-
-        std::wstring cacheKey = std::to_wstring(tableId) + L"_" + name;
-        auto it = getCache().find(name);
-        if (it != getCache().end())
-            return it->second;
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto tableIt = snapshot->nameIds.find(tableId);
+            if (tableIt != snapshot->nameIds.end())
+            {
+                auto it = tableIt->second.find(name);
+                if (it != tableIt->second.end())
+                    return it->second;
+            }
+        }
 
         if (!isWord(name))
             throw fourdberr("names.getId name is not valid: " + toNarrowStr(name));
@@ -44,43 +53,71 @@ namespace fourdb
         paramap params
         {
             { L"@tableId", tableId },
-            { L"@name", name }
+            { L"@name", name },
+            { L"@isNumeric", isNumeric }
         };
-        std::wstring selectSql =
-            L"SELECT id FROM names WHERE tableid = @tableId AND name = @name";
-        int id = db.execScalarInt32(selectSql, params).value_or(-1);
-        if (id >= 0)
+
+        // Add it if it's not there, one statement for new names
+        if (!noCreate)
         {
-            getCache()[cacheKey] = id;
-            return id;
+            std::wstring insertSql =
+                L"INSERT INTO names (tableid, name, isNumeric) VALUES (@tableId, @name, @isNumeric) "
+                L"ON CONFLICT(name, tableid) DO NOTHING "
+                L"RETURNING id";
+            auto id = db.execScalarInt64(insertSql, params);
+            if (id.has_value())
+            {
+                name_obj nameObj;
+                nameObj.id = static_cast<int>(id.value());
+                nameObj.tableId = tableId;
+                nameObj.name = name;
+                nameObj.isNumeric = isNumeric;
+                if (schemaCatalog != nullptr)
+                    schemaCatalog->addName(nameObj);
+                return nameObj.id;
+            }
         }
 
-        if (noCreate)
+        std::wstring selectSql =
+            L"SELECT id, isNumeric FROM names WHERE tableid = @tableId AND name = @name";
         {
-            if (noException)
-                return -1;
-            else
-                throw fourdberr(toNarrowStr(L"names.getId cannot create new name: " + name));
+            auto reader = db.execReader(selectSql, params);
+            if (reader->read())
+            {
+                name_obj nameObj;
+                nameObj.id = reader->getInt32(0);
+                nameObj.tableId = tableId;
+                nameObj.name = name;
+                nameObj.isNumeric = reader->getBoolean(1);
+                if (schemaCatalog != nullptr)
+                    schemaCatalog->addName(nameObj);
+                return nameObj.id;
+            }
         }
 
-        params.insert({ L"@isNumeric", isNumeric });
-        std::wstring insertSql =
-            L"INSERT INTO names (tableid, name, isNumeric) VALUES (@tableId, @name, @isNumeric)";
-        id = static_cast<int>(db.execInsert(insertSql, params));
-        getCache()[cacheKey] = id;
-        return id;
+        if (!noCreate)
+            throw fourdberr(toNarrowStr(L"names.getId fails to add or find name: " + name));
+
+        if (noException)
+            return -1;
+        else
+            throw fourdberr(toNarrowStr(L"names.getId cannot create new name: " + name));
     }
 
     names::name_obj names::getName(db& db, int id)
     {
-        std::lock_guard<std::mutex> lock(getMutex());
-
-        auto it = getCacheBack().find(id);
-        if (it != getCacheBack().end())
-            return it->second;
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto it = snapshot->names.find(id);
+            if (it != snapshot->names.end())
+                return it->second;
+        }
 
-        std::wstring sql = L"SELECT tableid, name, isNumeric FROM names WHERE id = " + std::to_wstring(id);
-        auto reader = db.execReader(sql);
+        paramap params{ { L"@id", id } };
+        std::wstring sql = L"SELECT tableid, name, isNumeric FROM names WHERE id = @id";
+        auto reader = db.execReader(sql, params);
         if (!reader->read())
             throw fourdberr("names.getName fails to find record: " + std::to_string(id));
 
@@ -90,58 +127,29 @@ namespace fourdb
         retVal.name = reader->getString(1);
         retVal.isNumeric = reader->getBoolean(2);
 
-        getCacheBack()[id] = retVal;
+        if (schemaCatalog != nullptr)
+            schemaCatalog->addName(retVal);
 
         return retVal;
     }
 
     bool names::getNameIsNumeric(db& db, int id)
     {
-        std::lock_guard<std::mutex> lock(getMutex());
-
         if (id < 0)
             return false;
 
-        auto it = getNumericCache().find(id);
-        if (it != getNumericCache().end())
-            return it->second;
-
-        std::wstring sql = L"SELECT isNumeric FROM names WHERE id = " + std::to_wstring(id);
-        int numericNum = db.execScalarInt32(sql).value_or(0);
-        bool isNumeric = numericNum != 0;
-        getNumericCache()[id] = isNumeric;
-        return isNumeric;
-    }
-
-    void names::clearCaches()
-    {
-        std::lock_guard<std::mutex> lock(getMutex());
-        getCache().clear();
-        getCacheBack().clear();
-        getNumericCache().clear();
-    }
-
-    std::mutex& names::getMutex()
-    {
-        static std::mutex mtx;
-        return mtx;
-    }
-
-    std::unordered_map<std::wstring, int>& names::getCache()
-    {
-        static std::unordered_map<std::wstring, int> cache;
-        return cache;
-    }
-
-    std::unordered_map<int, names::name_obj>& names::getCacheBack()
-    {
-        static std::unordered_map<int, name_obj> cacheBack;
-        return cacheBack;
-    }
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto it = snapshot->names.find(id);
+            if (it != snapshot->names.end())
+                return it->second.isNumeric;
+        }
 
-    std::unordered_map<int, bool>& names::getNumericCache()
-    {
-        static std::unordered_map<int, bool> numericCache;
-        return numericCache;
+        paramap params{ { L"@id", id } };
+        std::wstring sql = L"SELECT isNumeric FROM names WHERE id = @id";
+        int numericNum = db.execScalarInt32(sql, params).value_or(0);
+        return numericNum != 0;
     }
 }
@@ -26,14 +26,5 @@ namespace fourdb
         static name_obj getName(db& db, int id);
 
         static bool getNameIsNumeric(db& db, int id);
-
-        static void clearCaches();
-
-    private:
-        static std::mutex& getMutex();
-
-        static std::unordered_map<std::wstring, int>& getCache();
-        static std::unordered_map<int, name_obj>& getCacheBack();
-        static std::unordered_map<int, bool>& getNumericCache();
     };
 }
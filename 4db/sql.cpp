@@ -2,8 +2,10 @@
 #include "sql.h"
 
 #include "db.h"
+#include "items.h"
 #include "names.h"
 #include "tables.h"
+#include "values.h"
 
 namespace fourdb
 {
@@ -12,6 +14,7 @@ namespace fourdb
         SELECT,
         FROM,
         WHERE,
+        GROUP,
         ORDER,
         LIMIT
     };
@@ -46,20 +49,12 @@ namespace fourdb
                     if (idx >= tokens.size())
                         throw fourdberr("No SELECT columns");
 
-                    currentToken = tokens[idx];
-
-                    bool lastColumn = currentToken.back() != ',';
-                    if (!lastColumn)
-                        currentToken = currentToken.substr(0, currentToken.length() - 1);
+                    retVal.selectCols.push_back(parseColumn(tokens, idx));
 
-                    validateColumnName(currentToken);
-                    retVal.selectCols.push_back(currentToken);
-
-                    if (lastColumn)
+                    if (idx >= tokens.size() || tokens[idx] != L",")
                         break;
                 }
 
-                ++idx;
                 curState = state::FROM;
                 continue;
             }
@@ -85,49 +80,78 @@ namespace fourdb
             {
                 if (_wcsicmp(currentToken.c_str(), L"WHERE") != 0)
                 {
-                    curState = state::ORDER;
+                    curState = state::GROUP;
                     continue;
                 }
 
-                // Gobble up WHERE criteria
+                // Gobble up WHERE criteria, ANDed together, with (... OR ...) groups
                 ++idx;
-                retVal.where.emplace_back(); // gotta start somewhere
-                criteriaset& crits = retVal.where.back();
-                while ((idx + 3) <= tokens.size())
+                if ((idx + 3) > tokens.size())
+                    throw fourdberr("No WHERE criteria");
+
+                retVal.where.emplace_back(); // the ANDed ones go here
+                while (true)
                 {
-                    criteria crit;
-                    crit.name = tokens[idx++];
-                    crit.op = tokens[idx++];
-                    crit.paramName = tokens[idx++];
-                    validateColumnName(crit.name);
-                    validateOperator(crit.op);
-                    validateParameterName(crit.paramName);
-                    crits.addCriteria(crit);
-
-                    if
-                        (
-                            (idx + 3) <= tokens.size()
-                            &&
-                            _wcsicmp(tokens[idx].c_str(), L"AND") == 0
-                            )
+                    if (idx < tokens.size() && tokens[idx] == L"(")
                     {
                         ++idx;
-                        continue;
+                        criteriaset group;
+                        bool haveCombine = false;
+                        while (true)
+                        {
+                            group.addCriteria(parseCriteria(tokens, idx));
+                            if (idx >= tokens.size())
+                                throw fourdberr("No closing parenthesis in WHERE");
+                            if (tokens[idx] == L")")
+                            {
+                                ++idx;
+                                break;
+                            }
+
+                            criteriaop combine;
+                            if (_wcsicmp(tokens[idx].c_str(), L"OR") == 0)
+                                combine = criteriaop::OR;
+                            else if (_wcsicmp(tokens[idx].c_str(), L"AND") == 0)
+                                combine = criteriaop::AND;
+                            else
+                                throw fourdberr("Invalid WHERE group");
+
+                            if (haveCombine && combine != group.combine)
+                                throw fourdberr("Mixed AND and OR in WHERE group, put them in groups of their own");
+                            group.combine = combine;
+                            haveCombine = true;
+                            ++idx;
+                        }
+
+                        if (group.combine == criteriaop::OR)
+                            retVal.where.push_back(group);
+                        else
+                        {
+                            for (const auto& crit : group.criterias)
+                                retVal.where[0].addCriteria(crit);
+                        }
                     }
                     else
                     {
-                        break;
+                        retVal.where[0].addCriteria(parseCriteria(tokens, idx));
                     }
+
+                    // Only an AND with something after it, otherwise it's left over at the end
+                    bool isAnd = idx < tokens.size() && _wcsicmp(tokens[idx].c_str(), L"AND") == 0;
+                    if (isAnd && ((idx + 4) <= tokens.size() || ((idx + 1) < tokens.size() && tokens[idx + 1] == L"(")))
+                        ++idx;
+                    else
+                        break;
                 }
 
-                if (crits.criterias.empty())
-                    throw fourdberr("No WHERE criteria");
+                if (retVal.where[0].criterias.empty())
+                    retVal.where.erase(retVal.where.begin());
 
-                curState = state::ORDER;
+                curState = state::GROUP;
                 continue;
             }
 
-            if (curState == state::ORDER)
+            if (curState == state::GROUP)
             {
                 std::wstring nextToken =
                     (idx + 1) < tokens.size() ? tokens[idx + 1] : std::wstring();
@@ -135,66 +159,77 @@ namespace fourdb
                     (
                         (idx + 3) > tokens.size()
                         ||
-                        _wcsicmp(currentToken.c_str(), L"ORDER") != 0
+                        _wcsicmp(currentToken.c_str(), L"GROUP") != 0
                         ||
                         _wcsicmp(nextToken.c_str(), L"BY") != 0
                         )
                 {
-                    curState = state::LIMIT;
+                    curState = state::ORDER;
                     continue;
                 }
 
                 idx += 2;
-
-                while (idx < tokens.size())
+                while (true)
                 {
-                    currentToken = tokens[idx];
-
-                    bool currentEnds = idx == tokens.size() - 1 || currentToken.back() == ',';
-
-                    nextToken = L"ASC";
-                    if (!currentEnds)
-                    {
-                        if ((idx + 1) < tokens.size())
-                            nextToken = tokens[++idx];
-                    }
+                    if (idx >= tokens.size())
+                        throw fourdberr("No GROUP BY column");
 
-                    bool nextEnds = nextToken.back() == ',';
+                    currentToken = tokens[idx++];
+                    validateColumnName(currentToken);
+                    retVal.groupBy.push_back(currentToken);
 
-                    bool isLimit = _wcsicmp(nextToken.c_str(), L"LIMIT") == 0;
+                    if (idx >= tokens.size() || tokens[idx] != L",")
+                        break;
+                    ++idx;
+                }
 
-                    bool lastColumn = isLimit || !(currentEnds || nextEnds);
+                curState = state::ORDER;
+                continue;
+            }
 
-                    if (!currentToken.empty() && currentToken.back() == ',')
-                        currentToken = currentToken.substr(0, currentToken.length() - 1);
+            if (curState == state::ORDER)
+            {
+                std::wstring nextToken =
+                    (idx + 1) < tokens.size() ? tokens[idx + 1] : std::wstring();
+                if
+                    (
+                        (idx + 3) > tokens.size()
+                        ||
+                        _wcsicmp(currentToken.c_str(), L"ORDER") != 0
+                        ||
+                        _wcsicmp(nextToken.c_str(), L"BY") != 0
+                        )
+                {
+                    curState = state::LIMIT;
+                    continue;
+                }
 
-                    if (!nextToken.empty() && nextToken.back() == ',')
-                        nextToken = nextToken.substr(0, nextToken.length() - 1);
+                idx += 2;
+                while (true)
+                {
+                    if (idx >= tokens.size())
+                        throw fourdberr("Invalid ORDER BY");
 
-                    bool isDescending;
+                    order orderObj;
+                    orderObj.field = parseColumn(tokens, idx);
+                    orderObj.descending = false;
+                    if (idx < tokens.size())
                     {
-                        if (_wcsicmp(nextToken.c_str(), L"ASC") == 0)
-                            isDescending = false;
-                        else if (_wcsicmp(nextToken.c_str(), L"DESC") == 0)
-                            isDescending = true;
-                        else if (isLimit)
-                            isDescending = false;
-                        else
-                            throw fourdberr("Invalid ORDER BY");
+                        if (_wcsicmp(tokens[idx].c_str(), L"ASC") == 0)
+                            ++idx;
+                        else if (_wcsicmp(tokens[idx].c_str(), L"DESC") == 0)
+                        {
+                            orderObj.descending = true;
+                            ++idx;
+                        }
                     }
-
-                    validateColumnName(currentToken);
-
-                    order orderObj;
-                    orderObj.field = currentToken;
-                    orderObj.descending = isDescending;
                     retVal.orderBy.push_back(orderObj);
 
-                    if (!isLimit)
-                        ++idx;
-
-                    if (lastColumn)
+                    if (idx >= tokens.size() || _wcsicmp(tokens[idx].c_str(), L"LIMIT") == 0)
                         break;
+                    else if (tokens[idx] != L",")
+                        throw fourdberr("Invalid ORDER BY");
+                    ++idx;
                 }
 
                 curState = state::LIMIT;
@@ -216,6 +251,18 @@ namespace fourdb
                     retVal.limit = limitVal;
 
                     ++idx;
+                    if (idx < tokens.size() && _wcsicmp(tokens[idx].c_str(), L"OFFSET") == 0)
+                    {
+                        ++idx;
+                        if (idx >= tokens.size())
+                            throw fourdberr("No OFFSET value");
+
+                        int offsetVal = _wtoi(tokens[idx].c_str());
+                        if (offsetVal < 0 || (offsetVal == 0 && tokens[idx] != L"0"))
+                            throw fourdberr("Invalid OFFSET value");
+                        retVal.offset = offsetVal;
+                        ++idx;
+                    }
                     break;
                 }
                 else
@@ -244,8 +291,9 @@ namespace fourdb
     /// </summary>
     /// <param name="db">Database connection</param>
     /// <param name="query">4db SQL query</param>
+    /// <param name="allNamesFound">Optional, set to whether the table and all columns exist</param>
     /// <returns>Database SQL</returns>
-    std::wstring sql::generateSql(db& db, select query)
+    std::wstring sql::generateSql(db& db, select query, bool* allNamesFound)
     {
         //
         // "COMPILE"
@@ -273,11 +321,95 @@ namespace fourdb
         for (const auto& crits : query.where)
         {
             for (const auto& crit : crits.criterias)
+                validateCriteria(crit);
+        }
+
+        // Aggregates are over all the rows, or over each GROUP BY group of them,
+        // so the other SELECT columns have to be ones the rows are grouped by
+        struct aggregate
+        {
+            std::wstring func;
+            bool isDistinct = false;
+            std::wstring name;
+        };
+        std::unordered_map<std::wstring, aggregate> aggregates;
+        for (const auto& col : query.selectCols)
+        {
+            aggregate agg;
+            if (parseAggregate(col, agg.func, agg.isDistinct, agg.name))
+                aggregates[col] = agg;
+        }
+
+        for (const auto& group : query.groupBy)
+        {
+            validateColumnName(group);
+            if (group == L"count" || group == L"rank")
+                throw fourdberr("Invalid query, can't GROUP BY " + toNarrowStr(group));
+        }
+
+        bool isAggregated = !aggregates.empty() || !query.groupBy.empty();
+        if (isAggregated)
+        {
+            for (const auto& col : query.selectCols)
+            {
+                if 
+                (
+                    col != L"count" && aggregates.find(col) == aggregates.end() 
+                    && 
+                    std::find(query.groupBy.begin(), query.groupBy.end(), col) == query.groupBy.end()
+                )
+                {
+                    throw 
+                        fourdberr
+                        (
+                            "Invalid query, SELECT columns must be aggregates or in the GROUP BY column list: " 
+                            + toNarrowStr(col)
+                        );
+                }
+            }
+
+            if (query.keyset)
+                throw fourdberr("Invalid query, keyset pagination can't be used with aggregates or GROUP BY");
+        }
+
+        if (query.offset >= 0 && query.limit <= 0)
+            throw fourdberr("Invalid query, OFFSET needs a LIMIT");
+
+        if (query.keyset)
+        {
+            if (std::find(query.selectCols.begin(), query.selectCols.end(), L"id") == query.selectCols.end())
+                throw fourdberr("Invalid query, keyset pagination needs id in the SELECT column list");
+
+            for (const auto& crits : query.where)
+            {
+                for (const auto& crit : crits.criterias)
+                {
+                    if (_wcsicmp(crit.op.c_str(), L"MATCHES") == 0)
+                        throw fourdberr("Invalid query, keyset pagination can't be used with MATCHES");
+                }
+            }
+
+            // The rows from the last one on, a seek on the first ORDER BY column,
+            // then the rest of the way in the keyset WHERE below
+            criteria keysetStart;
+            if (query.orderBy.empty())
+            {
+                keysetStart.name = L"id";
+                keysetStart.op = L">";
+                keysetStart.paramName = L"@keysetid";
+            }
+            else
             {
-                validateColumnName(crit.name);
-                validateOperator(crit.op);
-                validateParameterName(crit.paramName);
+                keysetStart.name = query.orderBy[0].field;
+                keysetStart.op = query.orderBy[0].descending ? L"<=" : L">=";
+                keysetStart.paramName = L"@keyset0";
             }
+
+            auto andIt = 
+                std::find_if(query.where.begin(), query.where.end(), [](const criteriaset& crits) { return crits.combine == criteriaop::AND; });
+            if (andIt == query.where.end())
+                andIt = query.where.insert(query.where.begin(), criteriaset());
+            andIt->addCriteria(keysetStart);
         }
 
 
@@ -287,11 +419,22 @@ namespace fourdb
         int tableId = tables::getId(db, query.from, false, true, true);
         auto tableObj = tables::getTable(db, tableId);
 
-        // Gather columns
-        std::vector<std::wstring> names(query.selectCols);
+        // Gather columns, the ones that are aggregated rather than the aggregates
+        auto getColumnName = [&aggregates](const std::wstring& col) -> const std::wstring&
+        {
+            auto aggIt = aggregates.find(col);
+            return aggIt == aggregates.end() ? col : aggIt->second.name;
+        };
+
+        std::vector<std::wstring> names;
+        for (const auto& col : query.selectCols)
+            names.push_back(getColumnName(col));
 
         for (const auto& orderBy : query.orderBy)
-            names.push_back(orderBy.field);
+            names.push_back(getColumnName(orderBy.field));
+
+        for (const auto& group : query.groupBy)
+            names.push_back(group);
 
         for (const auto& crits : query.where)
         {
@@ -330,64 +473,244 @@ namespace fourdb
             }
         }
 
+        if (allNamesFound != nullptr)
+        {
+            *allNamesFound = tableObj.has_value();
+            for (const auto& name : names)
+            {
+                if (!isNameReserved(name) && !nameObjs[name].has_value())
+                    *allNamesFound = false;
+            }
+        }
+
+
+        // Counting the rows in a table only takes the items table
+        // The count is one row, so an OFFSET past it goes the long way, to come back with none
+        if 
+        (
+            query.where.empty() && query.groupBy.empty() && query.offset <= 0 
+            && 
+            query.selectCols.size() == 1 && query.selectCols[0] == L"count"
+        )
+            return L"SELECT COUNT(*) AS count FROM items WHERE tableid = " + std::to_wstring(tableId);
+
+
+        // Ordering by a column with its own index that the WHERE requires the rows to have,
+        // the rows can be gone through in the index's order, with no sorting
+        std::wstring indexOrderName, indexOrderLabel;
+        if (!query.orderBy.empty() && tableObj.has_value())
+        {
+            const std::wstring& name = query.orderBy[0].field;
+            bool isRequired = false, isMatched = false;
+            for (const auto& crits : query.where)
+            {
+                for (const auto& crit : crits.criterias)
+                {
+                    if (crit.name != name)
+                        continue;
+                    else if (_wcsicmp(crit.op.c_str(), L"MATCHES") == 0)
+                        isMatched = true; // the full-text join needs the column data
+                    else if (crits.combine == criteriaop::AND || crits.criterias.size() == 1)
+                        isRequired = true;
+                }
+            }
+
+            if 
+            (
+                isRequired && !isMatched 
+                && 
+                !isNameReserved(name) && nameObjs[name].has_value() 
+                && 
+                items::isColumnIndexed(db, tableId, nameObjs[name]->id)
+            )
+            {
+                indexOrderName = name;
+                indexOrderLabel = L"cx" + cleanseName(name);
+            }
+        }
+
 
         //
         // SELECT
         //
-        std::wstring selectPart;
-        for (const auto& name : query.selectCols)
+        auto getColumnExpr = [&](const std::wstring& name) -> std::wstring
         {
-            auto cleanName = cleanseName(name);
-
-            if (!selectPart.empty())
-                selectPart += L",\n";
-
             if (name == L"value")
             {
                 if (!tableObj.has_value())
-                    selectPart += L"NULL";
+                    return L"NULL";
                 else if (tableObj->isNumeric)
-                    selectPart += L"bv.numberValue";
+                    return L"bv.numberValue";
                 else
-                    selectPart += L"bv.stringValue";
+                    return L"bv.stringValue";
             }
             else if (name == L"id")
-                selectPart += L"i.id";
+                return L"i.id";
             else if (name == L"created")
-                selectPart += L"i.created";
+                return L"i.created";
             else if (name == L"lastmodified")
-                selectPart += L"i.lastmodified";
+                return L"i.lastmodified";
             else if (name == L"count")
-                selectPart += L"COUNT(*)";
+                return L"COUNT(*)";
             else if (name == L"rank")
-                selectPart += L"rank";
+                return L"rank";
             else if (!nameObjs[name].has_value())
-                selectPart += L"NULL";
+                return L"NULL";
+            else if (name == indexOrderName)
+                return indexOrderLabel + L".value";
             else if (nameObjs[name]->isNumeric)
-                selectPart += L"iv" + cleanName + L".numberValue";
+                return L"iv" + cleanseName(name) + L".numberValue";
+            else
+                return L"iv" + cleanseName(name) + L".stringValue";
+        };
+
+        // Aggregates are named like sum_num, cleansed names never have underscores
+        auto getColumnAlias = [&aggregates](const std::wstring& col)
+        {
+            auto aggIt = aggregates.find(col);
+            if (aggIt == aggregates.end())
+                return cleanseName(col);
+            else
+                return aggIt->second.func + (aggIt->second.isDistinct ? L"_distinct_" : L"_") + cleanseName(aggIt->second.name);
+        };
+
+        std::wstring selectPart;
+        std::unordered_map<std::wstring, std::wstring> selectExprs; // for the keyset WHERE
+        for (const auto& col : query.selectCols)
+        {
+            std::wstring expr;
+            auto aggIt = aggregates.find(col);
+            if (aggIt == aggregates.end())
+            {
+                expr = getColumnExpr(col);
+            }
             else
-                selectPart += L"iv" + cleanName + L".stringValue";
+            {
+                const auto& agg = aggIt->second;
+                std::wstring funcSql = agg.func;
+                for (auto& c : funcSql)
+                    c = towupper(c);
+
+                bool isNumeric = 
+                    agg.name == L"value" 
+                    ? tableObj.has_value() && tableObj->isNumeric 
+                    : isNameReserved(agg.name) || !nameObjs[agg.name].has_value() || nameObjs[agg.name]->isNumeric;
+                if ((agg.func == L"sum" || agg.func == L"avg") && !isNumeric)
+                    throw fourdberr("Invalid query, " + toNarrowStr(funcSql) + " needs a numeric column: " + toNarrowStr(agg.name));
+
+                expr = funcSql + L"(" + (agg.isDistinct ? L"DISTINCT " : L"") + getColumnExpr(agg.name) + L")";
+            }
 
-            selectPart += L" AS " + cleanName;
+            if (!selectPart.empty())
+                selectPart += L",\n";
+            selectPart += expr + L" AS " + getColumnAlias(col);
+            selectExprs[col] = expr;
         }
         selectPart = L"SELECT\n" + selectPart;
 
+        // Aggregating one column of the whole table only takes that column's data,
+        // gone through in the itemnamevalues (nameid, valueid, itemid) index, so in value order
+        if
+        (
+            query.where.empty() && query.groupBy.empty() && query.orderBy.empty() && query.limit <= 0
+            &&
+            !aggregates.empty() && aggregates.size() == query.selectCols.size()
+        )
+        {
+            const std::wstring& name = aggregates.begin()->second.name;
+            bool isOneColumn =
+                std::all_of(aggregates.begin(), aggregates.end(), [&name](const auto& agg) { return agg.second.name == name; });
+            if (isOneColumn && !isNameReserved(name) && nameObjs[name].has_value())
+            {
+                auto cleanName = cleanseName(name);
+                return
+                    selectPart +
+                    L"\n\nFROM\nitemnamevalues AS inv" + cleanName +
+                    L"\nJOIN bvalues AS iv" + cleanName + L" ON iv" + cleanName + L".id = inv" + cleanName + L".valueid" +
+                    L"\n\nWHERE\ninv" + cleanName + L".nameid = " + std::to_wstring(nameObjs[name]->id);
+            }
+        }
+
 
         //
         // FROM
         //
+        // Columns are only joined in for the SELECT and ORDER BY,
+        // and for comparisons that can't be done from the value side
+        auto isSeekable = [&](const criteria& where)
+        {
+            if (!isSeekOp(where.op) || where.name == indexOrderName)
+                return false;
+            else if (where.name == L"value")
+                return tableObj.has_value();
+            else
+                return !isNameReserved(where.name) && nameObjs[where.name].has_value();
+        };
+
+        std::unordered_set<std::wstring> joinNames;
+        for (const auto& col : query.selectCols)
+            joinNames.insert(getColumnName(col));
+        for (const auto& orderBy : query.orderBy)
+            joinNames.insert(getColumnName(orderBy.field));
+        for (const auto& group : query.groupBy)
+            joinNames.insert(group);
+        for (const auto& crits : query.where)
+        {
+            for (const auto& crit : crits.criterias)
+            {
+                if (!isSeekable(crit))
+                    joinNames.insert(crit.name);
+            }
+        }
+
+        // No comparison is true for NULL, so a row can only match if it has the columns
+        // that the WHERE has to have; INNER JOINs for those leave SQLite free to start with them
+        // Columns found from the value side stay LEFT JOINs, their seeks are the better start
+        std::unordered_set<std::wstring> nullRejectedNames;
+        for (const auto& crits : query.where)
+        {
+            bool allSameName = true;
+            for (const auto& crit : crits.criterias)
+            {
+                if (crit.name != crits.criterias[0].name)
+                    allSameName = false;
+            }
+
+            for (const auto& crit : crits.criterias)
+            {
+                if ((crits.combine == criteriaop::AND || allSameName) && !isSeekable(crit))
+                    nullRejectedNames.insert(crit.name);
+            }
+        }
+
         std::wstring fromPart = L"FROM\nitems AS i";
-        if (nameObjs.find(L"value") != nameObjs.end())
+        if (!indexOrderName.empty())
+        {
+            fromPart =
+                L"FROM\n" + items::getColumnIndexTableName(tableId, nameObjs[indexOrderName]->id) + L" AS " + indexOrderLabel +
+                L"\nJOIN items AS i ON i.id = " + indexOrderLabel + L".itemid";
+        }
+        if (joinNames.find(L"value") != joinNames.end())
             fromPart += L"\nJOIN bvalues bv ON bv.id = i.valueid";
 
         for (const auto& name : names)
         {
-            if (!isNameReserved(name) && nameObjs[name].has_value())
+            if 
+            (
+                !isNameReserved(name) && nameObjs[name].has_value() 
+                && 
+                joinNames.find(name) != joinNames.end() && name != indexOrderName
+            )
             {
                 auto cleanName = cleanseName(name);
+                std::wstring joinType = nullRejectedNames.find(name) != nullRejectedNames.end() ? L"JOIN" : L"LEFT OUTER JOIN";
+
+                // Not the itemvalues view, SQLite can't flatten a view with a join in it
+                // into a LEFT JOIN, so it would build the whole view for every query
                 fromPart +=
-                    L"\nLEFT OUTER JOIN itemvalues AS iv" + cleanName + L" ON iv" + cleanName + L".itemid = i.id"
-                    L" AND iv" + cleanName + L".nameid = " + std::to_wstring(nameObjs[name]->id);
+                    L"\n" + joinType + L" itemnamevalues AS inv" + cleanName + L" ON inv" + cleanName + L".itemid = i.id"
+                    L" AND inv" + cleanName + L".nameid = " + std::to_wstring(nameObjs[name]->id) +
+                    L"\n" + joinType + L" bvalues AS iv" + cleanName + L" ON iv" + cleanName + L".id = inv" + cleanName + L".valueid";
             }
         }
 
@@ -402,25 +725,113 @@ namespace fourdb
 
             wherePart += L"(";
             bool addedOneYet = false;
-            for (const auto& where : crits.criterias)
+            auto addCondition = [&](const std::wstring& condition)
             {
-                std::wstring name = where.name;
                 if (!addedOneYet)
                     addedOneYet = true;
                 else
                     wherePart += L" " + std::wstring(crits.opName()) + L" ";
+                wherePart += condition;
+            };
+
+            // Comparisons that the value indexes can answer are done from the value side,
+            // rather than by looking at the column data of every row in the table
+            // Comparisons on the same column go together, so a range or a list of ORs is one seek
+            std::vector<std::wstring> seekNames;
+            std::unordered_map<std::wstring, std::vector<const criteria*>> seekCrits;
+            std::unordered_set<const criteria*> soughtWheres;
+            for (const auto& where : crits.criterias)
+            {
+                if (!isSeekable(where))
+                    continue;
+
+                const std::wstring& seekName = where.name;
+                auto seekIt = seekCrits.find(seekName);
+                if (seekIt == seekCrits.end())
+                {
+                    seekNames.push_back(seekName);
+                    seekIt = seekCrits.insert({ seekName, {} }).first;
+                }
+                seekIt->second.push_back(&where);
+                soughtWheres.insert(&where);
+            }
+
+            // ORing seeks on different columns, each seek gives rows of its own and SQLite can't
+            // start from more than one, so they go together into one set of rows to start from
+            bool isSeekUnion = crits.combine == criteriaop::OR && seekNames.size() > 1 && soughtWheres.size() == crits.criterias.size();
+            std::wstring seekUnion;
+
+            for (const auto& seekName : seekNames)
+            {
+                const auto& seekWheres = seekCrits[seekName];
+                const std::wstring& name = seekWheres[0]->name;
+                std::wstring seekSql;
+                if (name == L"value")
+                {
+                    seekSql = getSeekSql(-1, tableObj->isNumeric, seekWheres, crits.combine);
+                }
+                else
+                {
+                    int nameId = nameObjs[name]->id;
+                    std::wstring indexTable = 
+                        items::isColumnIndexed(db, tableId, nameId) 
+                        ? items::getColumnIndexTableName(tableId, nameId) 
+                        : L"";
+                    seekSql = getSeekSql(nameId, nameObjs[name]->isNumeric, seekWheres, crits.combine, indexTable);
+                }
+
+                if (!isSeekUnion)
+                    addCondition(seekSql);
+                else
+                    seekUnion += (seekUnion.empty() ? L"" : L" UNION ") + std::wstring(L"SELECT i.id FROM items AS i WHERE ") + seekSql;
+            }
+            if (isSeekUnion)
+                addCondition(L"i.id IN (" + seekUnion + L")");
+
+            for (const auto& where : crits.criterias)
+            {
+                if (soughtWheres.find(&where) != soughtWheres.end())
+                    continue;
 
+                std::wstring name = where.name;
                 auto nameObj = nameObjs[name];
                 auto cleanName = cleanseName(name);
 
                 if (_wcsicmp(where.op.c_str(), L"MATCHES") == 0)
                 {
+                    int matchNameId = cleanName == L"value" ? 0 : nameObj.has_value() ? nameObj->id : -1;
+                    if (!tableObj.has_value() || matchNameId < 0)
+                    {
+                        addCondition(L"1 = 0"); // nothing to search
+                        continue;
+                    }
+                    if (!values::isSearchable(db, tableId, matchNameId))
+                        throw fourdberr("Column is not searchable, see ctxt::setSearchable: " + toNarrowStr(name));
+
+                    // ORed with other comparisons, the rows without a match can't be joined away,
+                    // so the matching values are looked up on their own, and there's no rank to order by
+                    std::wstring matchColumnLabel = cleanName == L"value" ? L"i.valueid" : L"inv" + cleanName + L".valueid";
+                    if (crits.combine == criteriaop::OR && crits.criterias.size() > 1)
+                    {
+                        if (std::find(query.selectCols.begin(), query.selectCols.end(), L"rank") != query.selectCols.end())
+                            throw fourdberr("Invalid query, rank can't be used with MATCHES in an OR group");
+
+                        addCondition
+                        (
+                            matchColumnLabel + L" IN (SELECT rowid FROM " + values::getTextTableName(tableId, matchNameId) + 
+                            L" WHERE stringSearchValue MATCH " + where.paramName + L")"
+                        );
+                        continue;
+                    }
+
+                    // Search the column's own full-text index, not the full-text of every column
                     std::wstring matchTableLabel = cleanName == L"value" ? L"bvtValue" : L"bvt" + cleanName;
-                    std::wstring matchColumnLabel = cleanName == L"value" ? L"i.valueid" : L"iv" + cleanName + L".valueid";
 
-                    fromPart += L"\nJOIN bvaluetext " + matchTableLabel + L" ON " + matchColumnLabel + L" = " + matchTableLabel + L".valueid";
+                    fromPart += 
+                        L"\nJOIN " + values::getTextTableName(tableId, matchNameId) + L" AS " + matchTableLabel + 
+                        L" ON " + matchTableLabel + L".rowid = " + matchColumnLabel;
 
-                    wherePart += matchTableLabel + L".stringSearchValue MATCH " + where.paramName;
+                    addCondition(matchTableLabel + L".stringSearchValue MATCH " + where.paramName);
 
                     order orderBy;
                     orderBy.field = L"rank";
@@ -429,40 +840,72 @@ namespace fourdb
                 }
                 else if (cleanName == L"id")
                 {
-                    wherePart += L"i.id " + where.op + L" " + where.paramName;
+                    addCondition(getConditionSql(L"i.id", where));
                 }
                 else if (cleanName == L"value")
                 {
                     if (!tableObj.has_value())
-                        wherePart += L"1 = 0"; // no table, no match
+                        addCondition(L"1 = 0"); // no table, no match
                     else if (tableObj->isNumeric)
-                        wherePart += L"bv.numberValue " + where.op + L" " + where.paramName;
+                        addCondition(getConditionSql(L"bv.numberValue", where));
                     else
-                        wherePart += L"bv.stringValue " + where.op + L" " + where.paramName;
+                        addCondition(getConditionSql(L"bv.stringValue", where));
                 }
                 else if (cleanName == L"created" || cleanName == L"lastmodified")
                 {
-                    wherePart += cleanName + L" " + where.op + L" " + where.paramName;
+                    addCondition(getConditionSql(cleanName, where));
                 }
                 else if (!nameObj.has_value())
                 {
-                    wherePart += L"1 = 0"; // name doesn't exist, no match!
+                    addCondition(L"1 = 0"); // name doesn't exist, no match!
+                }
+                else if (name == indexOrderName)
+                {
+                    addCondition(getConditionSql(indexOrderLabel + L".value", where));
                 }
                 else if (nameObj->isNumeric)
                 {
-                    wherePart += L"iv" + cleanName + L".numberValue " + where.op + L" " + where.paramName;
+                    addCondition(getConditionSql(L"iv" + cleanName + L".numberValue", where));
                 }
                 else
                 {
-                    wherePart += L"iv" + cleanName + L".stringValue " + where.op + L" " + where.paramName;
+                    addCondition(getConditionSql(L"iv" + cleanName + L".stringValue", where));
                 }
             }
             wherePart += L")";
         }
+        // Keyset pagination, the rows after the last row in (ORDER BY columns..., id) order
+        // (a > @keyset0 OR (a = @keyset0 AND (b < @keyset1 OR (b = @keyset1 AND i.id > @keysetid))))
+        // Going through a column index, it has the IDs in order after the values
+        std::wstring idExpr = indexOrderName.empty() ? L"i.id" : indexOrderLabel + L".itemid";
+        bool isIdLastOrder = !query.orderBy.empty() && query.orderBy.back().field == L"id";
+        bool isIdDescending = !query.orderBy.empty() && query.orderBy.back().descending;
+        if (query.keyset)
+        {
+            std::wstring keysetSql = idExpr + (isIdDescending ? L" < " : L" > ") + L"@keysetid";
+            for (size_t o = query.orderBy.size(); o-- > 0; )
+            {
+                const std::wstring& expr = selectExprs[query.orderBy[o].field];
+                std::wstring paramName = L"@keyset" + std::to_wstring(o);
+                keysetSql =
+                    L"(" + expr + (query.orderBy[o].descending ? L" < " : L" > ") + paramName +
+                    L" OR (" + expr + L" = " + paramName + L" AND " + keysetSql + L"))";
+            }
+            wherePart += L"\nAND\n" + keysetSql;
+        }
+
         if (!wherePart.empty())
             wherePart = L"WHERE\n" + wherePart;
 
 
+        //
+        // GROUP BY
+        //
+        std::wstring groupByPart;
+        for (const auto& group : query.groupBy)
+            groupByPart += (groupByPart.empty() ? L"GROUP BY\n" : L",\n") + getColumnExpr(group);
+
+
         //
         // ORDER BY
         //
@@ -474,11 +917,30 @@ namespace fourdb
 
             std::wstring orderColumn = order.field;
             if (!isNameReserved(orderColumn))
-                orderColumn = cleanseName(orderColumn);
+                orderColumn = getColumnAlias(orderColumn);
 
             orderBy += orderColumn + (order.descending ? L" DESC" : L" ASC");
         }
 
+        // Each row in a place of its own, so the pages of a LIMIT query line up
+        // and the next page can start after the last row, see select::startAfter
+        // Grouped, each group is a row, and the GROUP BY columns place it
+        if (isAggregated)
+        {
+            if (query.limit > 0 && !query.orderBy.empty())
+            {
+                for (const auto& group : query.groupBy)
+                {
+                    auto orderIt = 
+                        std::find_if(query.orderBy.begin(), query.orderBy.end(), [&group](const order& o) { return o.field == group; });
+                    if (orderIt == query.orderBy.end())
+                        orderBy += L",\n" + getColumnExpr(group) + L" ASC";
+                }
+            }
+        }
+        else if ((query.keyset || (query.limit > 0 && !query.orderBy.empty())) && !isIdLastOrder)
+            orderBy += (orderBy.empty() ? L"" : L",\n") + idExpr + (isIdDescending ? L" DESC" : L" ASC");
+
         if (!orderBy.empty())
             orderBy = L"ORDER BY\n" + orderBy;
 
@@ -489,6 +951,8 @@ namespace fourdb
         std::wstring limitPart;
         if (query.limit > 0)
             limitPart = L"LIMIT\n" + std::to_wstring(query.limit);
+        if (query.limit > 0 && query.offset >= 0)
+            limitPart += L"\nOFFSET\n" + std::to_wstring(query.offset);
 
 
         //
@@ -503,6 +967,9 @@ namespace fourdb
         if (!wherePart.empty())
             sql += L"\n\n" + wherePart;
 
+        if (!groupByPart.empty())
+            sql += L"\n\n" + groupByPart;
+
         if (!orderBy.empty())
             sql += L"\n\n" + orderBy;
 
@@ -512,6 +979,251 @@ namespace fourdb
         return sql;
     }
 
+    criteria sql::parseCriteria(const std::vector<std::wstring>& tokens, size_t& idx)
+    {
+        if ((idx + 3) > tokens.size())
+            throw fourdberr("Incomplete WHERE criteria");
+
+        criteria crit;
+        crit.name = tokens[idx++];
+        crit.op = tokens[idx++];
+        if (_wcsicmp(crit.op.c_str(), L"IN") == 0)
+        {
+            crit.op = L"IN";
+            if (tokens[idx] != L"(")
+            {
+                crit.paramName = tokens[idx++];
+            }
+            else
+            {
+                // Parameter names are words, so the commas can go anywhere
+                ++idx;
+                while (true)
+                {
+                    if (idx >= tokens.size())
+                        throw fourdberr("No closing parenthesis in IN list");
+
+                    const std::wstring& token = tokens[idx++];
+                    if (token == L")")
+                        break;
+
+                    std::wstring paramName;
+                    for (auto c : token + L",")
+                    {
+                        if (c != ',')
+                            paramName += c;
+                        else if (!paramName.empty())
+                        {
+                            crit.paramNames.push_back(paramName);
+                            paramName.clear();
+                        }
+                    }
+                }
+            }
+        }
+        else if (_wcsicmp(crit.op.c_str(), L"BETWEEN") == 0)
+        {
+            crit.op = L"BETWEEN";
+            if ((idx + 3) > tokens.size() || _wcsicmp(tokens[idx + 1].c_str(), L"AND") != 0)
+                throw fourdberr("Invalid BETWEEN, should be BETWEEN @lo AND @hi");
+            crit.paramNames.push_back(tokens[idx]);
+            crit.paramNames.push_back(tokens[idx + 2]);
+            idx += 3;
+        }
+        else
+        {
+            crit.paramName = tokens[idx++];
+        }
+
+        validateCriteria(crit);
+        return crit;
+    }
+
+    void sql::validateCriteria(const criteria& where)
+    {
+        validateColumnName(where.name);
+        validateOperator(where.op);
+
+        if (_wcsicmp(where.op.c_str(), L"BETWEEN") == 0 && where.paramNames.size() != 2)
+            throw fourdberr("Invalid BETWEEN, should have two parameters");
+
+        if (_wcsicmp(where.op.c_str(), L"IN") == 0 && where.paramName.empty() && where.paramNames.empty())
+            throw fourdberr("Invalid IN, should have a list parameter or a list of parameters");
+
+        if (where.paramNames.empty())
+            validateParameterName(where.paramName);
+        else if (!where.paramName.empty())
+            throw fourdberr("Invalid criteria, should have a parameter or a list of parameters, not both");
+
+        for (const auto& paramName : where.paramNames)
+            validateParameterName(paramName);
+    }
+
+    std::wstring sql::getConditionSql(const std::wstring& column, const criteria& where)
+    {
+        if (_wcsicmp(where.op.c_str(), L"IN") == 0)
+        {
+            // A list parameter is a JSON array, see select::addParam
+            if (where.paramNames.empty())
+                return column + L" IN (SELECT value FROM json_each(" + where.paramName + L"))";
+            else
+                return column + L" IN (" + join(where.paramNames, L", ") + L")";
+        }
+        else if (_wcsicmp(where.op.c_str(), L"BETWEEN") == 0)
+        {
+            return column + L" BETWEEN " + where.paramNames[0] + L" AND " + where.paramNames[1];
+        }
+        else
+        {
+            return column + L" " + where.op + L" " + where.paramName;
+        }
+    }
+
+    bool sql::isSeekOp(const std::wstring& op)
+    {
+        return 
+            op == L"=" || op == L"==" 
+            || 
+            op == L"<" || op == L"<=" 
+            || 
+            op == L">" || op == L">="
+            ||
+            _wcsicmp(op.c_str(), L"IN") == 0 || _wcsicmp(op.c_str(), L"BETWEEN") == 0;
+    }
+
+    std::wstring sql::getSeekSql
+    (
+        int nameId, 
+        bool isNumeric, 
+        const std::vector<const criteria*>& wheres, 
+        criteriaop combine, 
+        const std::wstring& indexTable
+    )
+    {
+        std::wstring valueColumn = !indexTable.empty() ? L"value" : isNumeric ? L"numberValue" : L"stringValue";
+        std::wstring conditions;
+        for (const auto* where : wheres)
+        {
+            if (!conditions.empty())
+                conditions += combine == criteriaop::OR ? L" OR " : L" AND ";
+            conditions += getConditionSql(valueColumn, *where);
+        }
+        if (combine == criteriaop::OR && wheres.size() > 1)
+            conditions = L"(" + conditions + L")";
+
+        // A column with its own index has the values and the rows in one place
+        if (!indexTable.empty())
+            return L"i.id IN (SELECT itemid FROM " + indexTable + L" WHERE " + conditions + L")";
+
+        // The bvalues indexes lead with the value and include isNumeric and the ID
+        std::wstring valuesSql = 
+            std::wstring(L"SELECT id FROM bvalues WHERE isNumeric = ") + (isNumeric ? L"1" : L"0") + L" AND " + conditions;
+
+        // The row keys are found in the items (valueid, tableid) index
+        if (nameId < 0)
+            return L"i.valueid IN (" + valuesSql + L")";
+
+        // The rows with the values are found in the itemnamevalues (nameid, valueid, itemid) index
+        return
+            L"i.id IN (SELECT itemid FROM itemnamevalues "
+            L"WHERE nameid = " + std::to_wstring(nameId) + L" AND valueid IN (" + valuesSql + L"))";
+    }
+
+    std::wstring sql::getQueryKey(const select& query)
+    {
+        // Names are words, so these separators cannot show up in them
+        std::wstring key = L"S:";
+        for (const auto& col : query.selectCols)
+            key += col + L",";
+
+        key += L"|F:" + query.from;
+
+        key += L"|W:";
+        for (const auto& crits : query.where)
+        {
+            key += L"(";
+            key += crits.opName();
+            for (const auto& crit : crits.criterias)
+            {
+                key += L" " + crit.name + L" " + toLower(crit.op) + L" " + crit.paramName;
+                for (const auto& paramName : crit.paramNames)
+                    key += L" " + paramName;
+                key += L",";
+            }
+            key += L")";
+        }
+
+        key += L"|G:";
+        for (const auto& group : query.groupBy)
+            key += group + L",";
+
+        key += L"|O:";
+        for (const auto& order : query.orderBy)
+            key += order.field + (order.descending ? L" D," : L" A,");
+
+        key += L"|L:" + std::to_wstring(query.limit) + L"," + std::to_wstring(query.offset);
+        if (query.keyset)
+            key += L"|K";
+        return key;
+    }
+
+    std::wstring sql::parseColumn(const std::vector<std::wstring>& tokens, size_t& idx)
+    {
+        std::wstring name = tokens[idx++];
+        if (idx >= tokens.size() || tokens[idx] != L"(")
+        {
+            validateColumnName(name);
+            return name;
+        }
+
+        // COUNT(*) is the count pseudo-column
+        std::wstring func = toLower(name);
+        if (func == L"count" && (idx + 3) <= tokens.size() && tokens[idx + 1] == L"*" && tokens[idx + 2] == L")")
+        {
+            idx += 3;
+            return L"count";
+        }
+
+        ++idx;
+        bool isDistinct = idx < tokens.size() && _wcsicmp(tokens[idx].c_str(), L"DISTINCT") == 0;
+        if (isDistinct)
+            ++idx;
+
+        if ((idx + 2) > tokens.size() || tokens[idx + 1] != L")")
+            throw fourdberr("Invalid aggregate, should be FUNC(column) or FUNC(DISTINCT column): " + toNarrowStr(name));
+        std::wstring column = func + L"(" + (isDistinct ? L"distinct " : L"") + tokens[idx] + L")";
+        idx += 2;
+
+        std::wstring aggregateName;
+        parseAggregate(column, func, isDistinct, aggregateName); // validates it
+        return column;
+    }
+
+    bool sql::parseAggregate(const std::wstring& column, std::wstring& func, bool& isDistinct, std::wstring& name)
+    {
+        size_t paren = column.find('(');
+        if (paren == std::wstring::npos)
+            return false;
+
+        if (column.back() != ')')
+            throw fourdberr("Invalid aggregate: " + toNarrowStr(column));
+
+        func = column.substr(0, paren);
+        if (func != L"sum" && func != L"avg" && func != L"min" && func != L"max" && func != L"count")
+            throw fourdberr("Invalid aggregate function: " + toNarrowStr(func));
+
+        name = column.substr(paren + 1, column.length() - paren - 2);
+        isDistinct = name.find(L"distinct ") == 0;
+        if (isDistinct)
+            name = name.substr(9);
+
+        validateColumnName(name);
+        if (name == L"count" || name == L"rank")
+            throw fourdberr("Invalid aggregate column: " + toNarrowStr(name));
+
+        return true;
+    }
+
     std::vector<std::wstring> sql::tokenize(const std::wstring& str)
     {
         std::vector<std::wstring> retVal;
@@ -519,13 +1231,17 @@ namespace fourdb
 
         for (auto c : str)
         {
-            if (iswspace(c))
+            if (iswspace(c) || c == '(' || c == ')' || c == ',')
             {
                 if (!cur.empty())
                 {
                     retVal.push_back(cur);
                     cur.clear();
                 }
+
+                // Parentheses and commas are tokens of their own
+                if (c == '(' || c == ')' || c == ',')
+                    retVal.push_back(std::wstring(1, c));
             }
             else
                 cur += c;
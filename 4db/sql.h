@@ -17,15 +17,61 @@ namespace fourdb
         /// <returns>select object ready for adding parameters and executing</returns>
         static select parse(const std::wstring& sql);
 
+        /// <summary>
+        /// UTF-8 version of parse
+        /// </summary>
+        static select parse(const std::string& sql)
+        {
+            return parse(toWideStr(sql));
+        }
+
         /// <summary>
         /// This is where the magic 4db query => SQL query conversion takes place
         /// </summary>
         /// <param name="db">Database connection</param>
         /// <param name="query">4db SQL query</param>
+        /// <param name="allNamesFound">Optional, set to whether the table and all columns exist;
+        /// if not, the SQL is only good until they do</param>
         /// <returns>Database SQL</returns>
-        static std::wstring generateSql(db& db, select query);
+        static std::wstring generateSql(db& db, select query, bool* allNamesFound = nullptr);
+
+        /// <summary>
+        /// Get a string that is the same for queries that generate the same SQL, 
+        /// whatever their parameter values
+        /// </summary>
+        /// <param name="query">4db SQL query</param>
+        /// <returns>Cache key for the query</returns>
+        static std::wstring getQueryKey(const select& query);
 
     private:
         static std::vector<std::wstring> tokenize(const std::wstring& str);
+
+        // A SELECT or ORDER BY column, name or FUNC([DISTINCT] name), aggregates coming out like sum(num)
+        static std::wstring parseColumn(const std::vector<std::wstring>& tokens, size_t& idx);
+
+        // Split an aggregate column like count(distinct genre) into its parts, false for plain columns
+        static bool parseAggregate(const std::wstring& column, std::wstring& func, bool& isDistinct, std::wstring& name);
+
+        // One WHERE comparison, name op @param, name IN (@a, @b, ...), name IN @list, or name BETWEEN @lo AND @hi
+        static criteria parseCriteria(const std::vector<std::wstring>& tokens, size_t& idx);
+
+        static void validateCriteria(const criteria& where);
+
+        // SQL for a comparison against a column of the generated SQL
+        static std::wstring getConditionSql(const std::wstring& column, const criteria& where);
+
+        // Can the comparison be done with an index seek on the value?
+        static bool isSeekOp(const std::wstring& op);
+
+        // SQL for the rows with the values that pass the comparisons, nameId -1 for the row key,
+        // using the column's own index if it has one, see items::addColumnIndex
+        static std::wstring getSeekSql
+        (
+            int nameId, 
+            bool isNumeric, 
+            const std::vector<const criteria*>& wheres, 
+            criteriaop combine, 
+            const std::wstring& indexTable = L""
+        );
     };
 }
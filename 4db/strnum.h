@@ -5,36 +5,107 @@
 namespace fourdb
 {
     /// <summary>
-    /// A strnum is either a wstring or a double
+    /// A strnum is either a string or a double
     /// Poor man's variant, it maps directly onto the virtual schema
+    /// Strings are held as UTF-8, like SQLite holds them, so they go in and out
+    /// of the database as they are; the wstring functions convert
+    /// It holds one or the other, never both, and short strings live inline
     /// </summary>
     class strnum
     {
     public:
         strnum()
             : m_isStr(false)
-            , m_str()
             , m_num(0.0)
         {}
 
         strnum(const std::wstring& str)
             : m_isStr(true)
-            , m_str(str)
-            , m_num(0.0)
+            , m_str(toNarrowStr(str))
+        {}
+
+        /// <summary>
+        /// UTF-8 string value, taken as is
+        /// </summary>
+        strnum(std::string utf8)
+            : m_isStr(true)
+            , m_str(std::move(utf8))
+        {}
+
+        strnum(const std::u8string& utf8)
+            : m_isStr(true)
+            , m_str(utf8.begin(), utf8.end())
         {}
 
         strnum(double num)
             : m_isStr(false)
-            , m_str()
             , m_num(num)
         {}
 
+        strnum(const strnum& other)
+            : m_isStr(other.m_isStr)
+        {
+            if (m_isStr)
+                new (&m_str) std::string(other.m_str);
+            else
+                m_num = other.m_num;
+        }
+
+        strnum(strnum&& other) noexcept
+            : m_isStr(other.m_isStr)
+        {
+            if (m_isStr)
+                new (&m_str) std::string(std::move(other.m_str));
+            else
+                m_num = other.m_num;
+        }
+
+        ~strnum()
+        {
+            if (m_isStr)
+                m_str.~basic_string();
+        }
+
+        strnum& operator=(const strnum& other)
+        {
+            if (this != &other)
+            {
+                if (m_isStr && other.m_isStr)
+                    m_str = other.m_str;
+                else
+                    assign(strnum(other));
+            }
+            return *this;
+        }
+
+        strnum& operator=(strnum&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (m_isStr && other.m_isStr)
+                    m_str = std::move(other.m_str);
+                else
+                    assign(std::move(other));
+            }
+            return *this;
+        }
+
         bool operator==(const strnum& other) const
         {
-            return m_isStr == other.m_isStr && m_str == other.m_str && m_num == other.m_num;
+            if (m_isStr != other.m_isStr)
+                return false;
+            else if (m_isStr)
+                return m_str == other.m_str;
+            else
+                return m_num == other.m_num;
         }
 
-        const std::wstring& str() const
+        std::wstring str() const
+        {
+            return toWideStr(utf8());
+        }
+
+        const std::string& utf8() const
         {
             if (!m_isStr)
                 throw std::runtime_error("not a string");
@@ -53,11 +124,28 @@ namespace fourdb
             return m_isStr;
         }
 
+        std::size_t hash() const
+        {
+            if (m_isStr)
+                return std::hash<std::string_view>()(m_str);
+
+            // 0.0 == -0.0, so they had better hash the same
+            uint64_t bits = m_num == 0.0 ? 0 : std::bit_cast<uint64_t>(m_num);
+
+            // splitmix64 finalizer, the bits of whole numbers are mostly zeros
+            bits ^= bits >> 30;
+            bits *= 0xbf58476d1ce4e5b9ULL;
+            bits ^= bits >> 27;
+            bits *= 0x94d049bb133111ebULL;
+            bits ^= bits >> 31;
+            return static_cast<std::size_t>(bits);
+        }
+
         std::wstring toSqlLiteral() const
         {
             if (m_isStr)
             {
-                std::wstring retVal = m_str; // replace modifies param in place
+                std::wstring retVal = str(); // replace modifies param in place
                 replace(retVal, L"\'", L"\'\'");
                 retVal = L"'" + retVal + L"'";
                 return retVal;
@@ -68,10 +156,48 @@ namespace fourdb
             }
         }
 
+        std::string toJson() const
+        {
+            if (!m_isStr)
+                return std::isfinite(m_num) ? toNarrowStr(num2str(m_num)) : std::string("null");
+
+            std::string retVal = "\"";
+            for (char c : m_str)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    retVal += '\\';
+                    retVal += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    retVal += "\\u00";
+                    retVal += hex[(c >> 4) & 0xF];
+                    retVal += hex[c & 0xF];
+                }
+                else
+                    retVal += c;
+            }
+            retVal += '"';
+            return retVal;
+        }
+
+    private:
+        // Switch from one type to the other, other is an rvalue we can steal from
+        void assign(strnum&& other) noexcept
+        {
+            this->~strnum();
+            new (this) strnum(std::move(other));
+        }
+
     private:
         bool m_isStr;
-        std::wstring m_str;
-        double m_num;
+        union
+        {
+            std::string m_str; // UTF-8
+            double m_num;
+        };
     };
 }
 
@@ -82,8 +208,7 @@ namespace std
     {
         std::size_t operator()(const fourdb::strnum& sn) const
         {
-            const std::hash<std::wstring> hasher;
-            return hasher(sn.isStr() ? sn.str() : std::to_wstring(sn.num()));
+            return sn.hash();
         }
     };
 }
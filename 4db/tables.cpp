@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "tables.h"
 
+#include "catalog.h"
+
 namespace fourdb
 {
     const wchar_t** tables::createSql()
@@ -20,55 +22,84 @@ namespace fourdb
     void tables::reset(db& db)
     {
         db.execSql(L"DELETE FROM tables");
-        clearCaches();
+        if (db.getCatalog() != nullptr)
+            db.getCatalog()->clear();
     }
 
     int tables::getId(db& db, std::wstring name, bool isNumeric, bool noCreate, bool noException)
     {
-        std::lock_guard<std::mutex> lock(getMutex());
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto it = snapshot->tableIds.find(name);
+            if (it != snapshot->tableIds.end())
+                return it->second;
+        }
 
-        auto it = getCache().find(name);
-        if (it != getCache().end())
-            return it->second;
+        paramap cmdParams{ { L"@name", name }, { L"@isNumeric", isNumeric } };
 
-        paramap cmdParams{ { L"@name", name } };
-        std::wstring selectSql = L"SELECT id FROM tables WHERE name = @name";
-        std::optional<int> idObj = db.execScalarInt32(selectSql, cmdParams);
-        int id = idObj.value_or(-1);
-        if (id >= 0)
+        // Add it if it's not there, one statement for new tables
+        if (!noCreate)
         {
-            getCache()[name] = id;
-            return id;
+            std::wstring insertSql =
+                L"INSERT INTO tables (name, isNumeric) VALUES (@name, @isNumeric) "
+                L"ON CONFLICT(name) DO NOTHING "
+                L"RETURNING id";
+            auto id = db.execScalarInt64(insertSql, cmdParams);
+            if (id.has_value())
+            {
+                table_obj obj;
+                obj.id = static_cast<int>(id.value());
+                obj.name = name;
+                obj.isNumeric = isNumeric;
+                if (schemaCatalog != nullptr)
+                    schemaCatalog->addTable(obj);
+                return obj.id;
+            }
         }
 
-        if (noCreate)
+        std::wstring selectSql = L"SELECT id, isNumeric FROM tables WHERE name = @name";
         {
-            if (noException)
-                return -1;
-
-            throw fourdberr("tables.getid cannot create new table: " + toNarrowStr(name));
+            auto reader = db.execReader(selectSql, cmdParams);
+            if (reader->read())
+            {
+                table_obj obj;
+                obj.id = reader->getInt32(0);
+                obj.name = name;
+                obj.isNumeric = reader->getBoolean(1);
+                if (schemaCatalog != nullptr)
+                    schemaCatalog->addTable(obj);
+                return obj.id;
+            }
         }
 
-        cmdParams.insert({ L"@isNumeric", isNumeric });
-        std::wstring insertSql = L"INSERT INTO tables (name, isNumeric) VALUES (@name, @isNumeric)";
-        id = static_cast<int>(db.execInsert(insertSql, cmdParams));
-        getCache()[name] = id;
-        return id;
+        if (!noCreate)
+            throw fourdberr("tables.getid fails to add or find table: " + toNarrowStr(name));
+
+        if (noException)
+            return -1;
+
+        throw fourdberr("tables.getid cannot create new table: " + toNarrowStr(name));
     }
 
     std::optional<tables::table_obj> tables::getTable(db& db, int id)
     {
-        std::lock_guard<std::mutex> lock(getMutex());
-
         if (id < 0)
             return std::nullopt;
 
-        auto it = getCacheBack().find(id);
-        if (it != getCacheBack().end())
-            return it->second;
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto it = snapshot->tables.find(id);
+            if (it != snapshot->tables.end())
+                return it->second;
+        }
 
-        std::wstring sql = L"SELECT name, isNumeric FROM tables WHERE id = " + std::to_wstring(id);
-        auto reader = db.execReader(sql);
+        paramap params{ { L"@id", id } };
+        std::wstring sql = L"SELECT name, isNumeric FROM tables WHERE id = @id";
+        auto reader = db.execReader(sql, params);
         if (!reader->read())
             throw fourdberr("tables.getTable fails to find record: " + std::to_string(id));
 
@@ -76,32 +107,8 @@ namespace fourdb
         obj.id = id;
         obj.name = reader->getString(0);
         obj.isNumeric = reader->getBoolean(1);
-        getCacheBack()[id] = obj;
+        if (schemaCatalog != nullptr)
+            schemaCatalog->addTable(obj);
         return obj;
     }
-
-    void tables::clearCaches()
-    {
-        std::lock_guard<std::mutex> lock(getMutex());
-        getCache().clear();
-        getCacheBack().clear();
-    }
-
-    std::mutex& tables::getMutex()
-    {
-        static std::mutex mtx;
-        return mtx;
-    }
-
-    std::unordered_map<std::wstring, int>& tables::getCache()
-    {
-        static std::unordered_map<std::wstring, int> cache;
-        return cache;
-    }
-
-    std::unordered_map<int, tables::table_obj>& tables::getCacheBack()
-    {
-        static std::unordered_map<int, table_obj> cacheBack;
-        return cacheBack;
-    }
 }
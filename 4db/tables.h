@@ -23,13 +23,5 @@ namespace fourdb
             bool isNumeric = false;
         };
         static std::optional<table_obj> getTable(db& db, int id);
-
-        static void clearCaches();
-
-    private:
-        static std::mutex& getMutex();
-
-        static std::unordered_map<std::wstring, int>& getCache();
-        static std::unordered_map<int, table_obj>& getCacheBack();
     };
 }
@@ -10,7 +10,8 @@ namespace fourdb
     {
         std::wstring name;
         std::wstring op;
-        std::wstring paramName;
+        std::wstring paramName; // for IN, a list parameter, see select::addParam
+        std::vector<std::wstring> paramNames; // IN (@a, @b, ...) and BETWEEN @lo AND @hi, instead of paramName
     };
 
     enum class criteriaop { AND, OR };
@@ -63,11 +64,14 @@ namespace fourdb
 
     struct select
     {
-        std::vector<std::wstring> selectCols;
+        std::vector<std::wstring> selectCols; // column names, or aggregates like sum(num) and count(distinct genre)
         std::wstring from; // FROM
         std::vector<criteriaset> where;
+        std::vector<std::wstring> groupBy; // GROUP BY
         std::vector<order> orderBy;
         int limit = -1;
+        int offset = -1; // LIMIT n OFFSET offset
+        bool keyset = false; // only the rows after the ones passed to startAfter
 
         paramap cmdParams;
 
@@ -77,6 +81,41 @@ namespace fourdb
             return *this;
         }
 
+        /// <summary>
+        /// Add a list parameter, for WHERE column IN @list
+        /// The values are passed as a JSON array, so the SQL is the same however many there are
+        /// </summary>
+        select& addParam(const std::wstring& name, const std::vector<strnum>& values)
+        {
+            std::string json = "[";
+            for (const auto& value : values)
+            {
+                if (json.size() > 1)
+                    json += ',';
+                json += value.toJson();
+            }
+            json += ']';
+            cmdParams.insert({ name, strnum(std::move(json)) });
+            return *this;
+        }
+
+        /// <summary>
+        /// Keyset pagination: only get the rows that come after a row in the ORDER BY order, 
+        /// so going to the next page is a range seek rather than going through all the pages before it
+        /// Queries with a LIMIT are ordered by ID after the ORDER BY columns, so each row has its own place
+        /// The ORDER BY columns should be ones all the rows have, for the rows to have places
+        /// </summary>
+        /// <param name="orderValues">The last row's values for the ORDER BY columns</param>
+        /// <param name="id">The last row's ID, so id has to be in the SELECT columns</param>
+        select& startAfter(const std::vector<strnum>& orderValues, int64_t id)
+        {
+            keyset = true;
+            for (size_t o = 0; o < orderValues.size(); ++o)
+                cmdParams.insert_or_assign(L"@keyset" + std::to_wstring(o), orderValues[o]);
+            cmdParams.insert_or_assign(L"@keysetid", static_cast<double>(id));
+            return *this;
+        }
+
         select& addOrder(std::wstring name, bool descending)
         {
             order _order;
@@ -85,6 +124,32 @@ namespace fourdb
             orderBy.push_back(_order);
             return *this;
         }
+
+        /// <summary>
+        /// Add an aggregate SELECT column, like the parser makes from SUM(num) or COUNT(DISTINCT genre)
+        /// Aggregates come back in columns named like sum_num and count_distinct_genre
+        /// </summary>
+        /// <param name="func">sum, avg, min, max, or count</param>
+        /// <param name="name">Column to aggregate</param>
+        /// <param name="distinct">Only aggregate each value once</param>
+        /// <returns>The aggregate column, for use in ORDER BY</returns>
+        std::wstring addAggregate(const std::wstring& func, const std::wstring& name, bool distinct = false)
+        {
+            std::wstring col = toLower(func) + L"(" + (distinct ? L"distinct " : L"") + name + L")";
+            selectCols.push_back(col);
+            return col;
+        }
+    };
+
+    /// <summary>
+    /// Rows fetched by primary key, see ctxt::getRows
+    /// Kept by column: values[c][r] is column c of row r, std::nullopt where the row does not have the column
+    /// </summary>
+    struct rowset
+    {
+        std::vector<std::wstring> columns;
+        std::vector<strnum> keys; // of the rows found, in the order asked for
+        std::vector<std::vector<std::optional<strnum>>> values;
     };
 
     // table name => column names, all kept in order
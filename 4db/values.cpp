@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "values.h"
 
+#include "catalog.h"
+
 namespace fourdb
 {
     const wchar_t** values::createSql()
@@ -18,8 +20,22 @@ namespace fourdb
 
             L"CREATE INDEX idx_bvalues_prefix ON bvalues (stringValue, isNumeric, id)",
             L"CREATE INDEX idx_bvalues_number ON bvalues (numberValue, isNumeric, id)",
+            nullptr
+        };
+        return sql;
+    }
+
+    const wchar_t** values::upgradeSql()
+    {
+        static const wchar_t* sql[] =
+        {
+            // The columns with full-text indexes, nameid 0 for the row key
+            L"CREATE TABLE IF NOT EXISTS searchcolumns\n(\n"
+            L"tableid INTEGER NOT NULL,\n"
+            L"nameid INTEGER NOT NULL,\n"
+            L"PRIMARY KEY (tableid, nameid)\n"
+            L")",
 
-            L"CREATE VIRTUAL TABLE bvaluetext USING fts5 (valueid, stringSearchValue)",
             nullptr
         };
         return sql;
@@ -28,33 +44,303 @@ namespace fourdb
     void values::reset(db& db)
     {
         db.execSql(L"DELETE FROM bvalues");
-        db.execSql(L"DELETE FROM bvaluetext");
+
+        for (const auto& searchColumn : getSearchColumns(db))
+            removeSearch(db, searchColumn.first, searchColumn.second);
+        db.execSql(L"DROP TABLE IF EXISTS bvaluetext");
     }
 
     int64_t values::getId(db& db, const strnum& value)
     {
-        int64_t id = getIdSelect(db, value);
+        // Add it if it's not there, one statement
+        int64_t id = getIdInsert(db, value);
         if (id >= 0)
             return id;
 
-        id = getIdInsert(db, value);
+        id = getIdSelect(db, value);
         return id;
     }
 
+    std::unordered_map<strnum, int64_t> values::getIds(db& db, const std::vector<strnum>& values)
+    {
+        std::unordered_map<strnum, int64_t> retVal;
+        std::vector<strnum> distinctValues;
+        for (const auto& value : values)
+        {
+            if (retVal.insert({ value, -1 }).second)
+                distinctValues.push_back(value);
+        }
+
+        if (distinctValues.size() < MIN_BATCH_SIZE)
+        {
+            for (const auto& value : distinctValues)
+                retVal[value] = getId(db, value);
+            return retVal;
+        }
+
+        loadValueBatch(db, distinctValues);
+
+        db.execSql
+        (
+            L"INSERT INTO bvalues (isNumeric, numberValue, stringValue) "
+            L"SELECT vb.isNumeric, vb.numberValue, vb.stringValue "
+            L"FROM temp.valuebatch AS vb "
+            L"WHERE NOT EXISTS "
+            L"(SELECT 1 FROM bvalues AS bv "
+            L"WHERE bv.stringValue = vb.stringValue AND bv.numberValue = vb.numberValue AND bv.isNumeric = vb.isNumeric) "
+            L"ORDER BY vb.idx"
+        );
+
+        auto reader =
+            db.execReader
+            (
+                L"SELECT vb.idx, bv.id "
+                L"FROM temp.valuebatch AS vb "
+                L"JOIN bvalues AS bv "
+                L"ON bv.stringValue = vb.stringValue AND bv.numberValue = vb.numberValue AND bv.isNumeric = vb.isNumeric"
+            );
+        while (reader->read())
+            retVal[distinctValues[static_cast<size_t>(reader->getInt64(0))]] = reader->getInt64(1);
+        reader.reset();
+
+        db.execSql(L"DELETE FROM temp.valuebatch");
+        return retVal;
+    }
+
+    void values::loadValueBatch(db& db, const std::vector<strnum>& values)
+    {
+        db.execSql
+        (
+            L"CREATE TEMP TABLE IF NOT EXISTS valuebatch\n(\n"
+            L"idx INTEGER PRIMARY KEY NOT NULL,\n"
+            L"isNumeric BOOLEAN NOT NULL,\n"
+            L"numberValue NUMBER NOT NULL,\n"
+            L"stringValue TEXT NOT NULL\n"
+            L")"
+        );
+        db.execSql(L"DELETE FROM temp.valuebatch");
+
+        // Stored just like getIdInsert does, strings with 0.0, numbers with ''
+        for (size_t idx = 0; idx < values.size(); ++idx)
+        {
+            const strnum& value = values[idx];
+            paramap params
+            {
+                { L"@idx", static_cast<double>(idx) },
+                { L"@isNumeric", value.isStr() ? 0.0 : 1.0 },
+                { L"@numberValue", value.isStr() ? 0.0 : value.num() },
+                { L"@stringValue", value.isStr() ? value : strnum(std::string()) }
+            };
+            db.execSql
+            (
+                L"INSERT INTO temp.valuebatch (idx, isNumeric, numberValue, stringValue) "
+                L"VALUES (@idx, @isNumeric, @numberValue, @stringValue)",
+                params
+            );
+        }
+    }
+
+    int values::deleteOrphans(db& db, int64_t afterId, int64_t upToId)
+    {
+        db.execSql(L"CREATE TEMP TABLE IF NOT EXISTS orphanbatch (id INTEGER PRIMARY KEY NOT NULL)");
+        db.execSql(L"DELETE FROM temp.orphanbatch");
+
+        paramap params
+        {
+            { L"@afterId", static_cast<double>(afterId) },
+            { L"@upToId", static_cast<double>(upToId) }
+        };
+        db.execSql
+        (
+            L"INSERT INTO temp.orphanbatch (id) "
+            L"SELECT bv.id FROM bvalues AS bv "
+            L"WHERE bv.id > @afterId AND bv.id <= @upToId "
+            L"AND NOT EXISTS (SELECT 1 FROM items AS i WHERE i.valueid = bv.id) "
+            L"AND NOT EXISTS (SELECT 1 FROM itemnamevalues AS inv WHERE inv.valueid = bv.id)",
+            params
+        );
+
+        int deleted = db.execSql(L"DELETE FROM bvalues WHERE id IN (SELECT id FROM temp.orphanbatch)");
+
+        db.execSql(L"DELETE FROM temp.orphanbatch");
+        return deleted;
+    }
+
+    std::wstring values::getTextTableName(int tableId, int nameId)
+    {
+        return L"bvaluetext_" + std::to_wstring(tableId) + L"_" + std::to_wstring(nameId);
+    }
+
+    std::vector<std::pair<int, int>> values::getSearchColumns(db& db)
+    {
+        std::vector<std::pair<int, int>> retVal;
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            for (const auto& tableIt : schemaCatalog->current()->searchNameIds)
+            {
+                for (int nameId : tableIt.second)
+                    retVal.push_back({ tableIt.first, nameId });
+            }
+        }
+        else
+        {
+            auto reader = db.execReader(L"SELECT tableid, nameid FROM searchcolumns");
+            while (reader->read())
+                retVal.push_back({ reader->getInt32(0), reader->getInt32(1) });
+        }
+        return retVal;
+    }
+
+    bool values::isSearchable(db& db, int tableId, int nameId)
+    {
+        catalog* schemaCatalog = db.getCatalog();
+        if (schemaCatalog != nullptr)
+        {
+            auto snapshot = schemaCatalog->current();
+            auto tableIt = snapshot->searchNameIds.find(tableId);
+            return tableIt != snapshot->searchNameIds.end() && tableIt->second.find(nameId) != tableIt->second.end();
+        }
+
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        return db.execScalarInt32(L"SELECT 1 FROM searchcolumns WHERE tableid = @tableId AND nameid = @nameId", params).has_value();
+    }
+
+    void values::addSearch(db& db, int tableId, int nameId)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        int added = 
+            db.execSql
+            (
+                L"INSERT INTO searchcolumns (tableid, nameid) VALUES (@tableId, @nameId) "
+                L"ON CONFLICT(tableid, nameid) DO NOTHING",
+                params
+            );
+        if (added == 0)
+            return;
+
+        // Keyed by value ID, for joining with the column data, and for compact to find
+        std::wstring textTable = getTextTableName(tableId, nameId);
+        db.execSql(L"CREATE VIRTUAL TABLE IF NOT EXISTS " + textTable + L" USING fts5 (stringSearchValue)");
+
+        // Index what's there already
+        if (nameId == 0)
+        {
+            db.execSql
+            (
+                L"INSERT INTO " + textTable + L" (rowid, stringSearchValue) "
+                L"SELECT v.id, v.stringValue FROM items AS i JOIN bvalues AS v ON v.id = i.valueid "
+                L"WHERE i.tableid = @tableId AND v.isNumeric = 0",
+                params
+            );
+        }
+        else
+        {
+            db.execSql
+            (
+                L"INSERT INTO " + textTable + L" (rowid, stringSearchValue) "
+                L"SELECT v.id, v.stringValue FROM bvalues AS v "
+                L"WHERE v.isNumeric = 0 AND v.id IN (SELECT valueid FROM itemnamevalues WHERE nameid = @nameId)",
+                params
+            );
+        }
+    }
+
+    void values::removeSearch(db& db, int tableId, int nameId)
+    {
+        paramap params{ { L"@tableId", tableId }, { L"@nameId", nameId } };
+        db.execSql(L"DELETE FROM searchcolumns WHERE tableid = @tableId AND nameid = @nameId", params);
+        db.execSql(L"DROP TABLE IF EXISTS " + getTextTableName(tableId, nameId));
+    }
+
+    void values::addText(db& db, int tableId, int nameId, const std::vector<int64_t>& valueIds)
+    {
+        std::wstring textTable = getTextTableName(tableId, nameId);
+        std::wstring sql =
+            L"INSERT INTO " + textTable + L" (rowid, stringSearchValue) "
+            L"SELECT id, stringValue FROM bvalues "
+            L"WHERE id = @id AND isNumeric = 0 AND NOT EXISTS (SELECT 1 FROM " + textTable + L" WHERE rowid = @id)";
+        for (int64_t valueId : valueIds)
+        {
+            paramap params{ { L"@id", static_cast<double>(valueId) } };
+            db.execSql(sql, params);
+        }
+    }
+
+    int values::deleteStaleText(db& db, int tableId, int nameId, int64_t afterId, int64_t upToId)
+    {
+        paramap params
+        {
+            { L"@tableId", tableId },
+            { L"@nameId", nameId },
+            { L"@afterId", static_cast<double>(afterId) },
+            { L"@upToId", static_cast<double>(upToId) }
+        };
+
+        // What the column still has in the range, from the items (valueid, tableid) 
+        // or itemnamevalues (nameid, valueid, itemid) index
+        std::wstring inUseSql =
+            nameId == 0
+            ? L"SELECT valueid FROM items WHERE valueid > @afterId AND valueid <= @upToId AND tableid = @tableId"
+            : L"SELECT valueid FROM itemnamevalues WHERE nameid = @nameId AND valueid > @afterId AND valueid <= @upToId";
+
+        return
+            db.execSql
+            (
+                L"DELETE FROM " + getTextTableName(tableId, nameId) + L" "
+                L"WHERE rowid > @afterId AND rowid <= @upToId AND rowid NOT IN (" + inUseSql + L")",
+                params
+            );
+    }
+
+    void values::optimizeText(db& db)
+    {
+        for (const auto& searchColumn : getSearchColumns(db))
+        {
+            std::wstring textTable = getTextTableName(searchColumn.first, searchColumn.second);
+            db.execSql(L"INSERT INTO " + textTable + L" (" + textTable + L") VALUES ('optimize')");
+        }
+    }
+
+    void values::upgradeText(db& db)
+    {
+        if (db.execScalarInt32(L"SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'bvaluetext'").value_or(0) == 0)
+            return;
+
+        std::vector<std::pair<int, int>> searchColumns;
+        {
+            auto reader = 
+                db.execReader
+                (
+                    L"SELECT id, 0 FROM tables WHERE isNumeric = 0 "
+                    L"UNION ALL "
+                    L"SELECT tableid, id FROM names WHERE isNumeric = 0"
+                );
+            while (reader->read())
+                searchColumns.push_back({ reader->getInt32(0), reader->getInt32(1) });
+        }
+
+        for (const auto& searchColumn : searchColumns)
+            addSearch(db, searchColumn.first, searchColumn.second);
+
+        db.execSql(L"DROP TABLE bvaluetext");
+    }
+
     strnum values::getValue(db& db, int64_t id)
     {
+        paramap params{ { L"@id", static_cast<double>(id) } };
         std::wstring sql =
             L"SELECT isNumeric, numberValue, stringValue FROM bvalues "
-            L"WHERE id = " + std::to_wstring(id);
+            L"WHERE id = @id";
 
-        auto reader = db.execReader(sql);
+        auto reader = db.execReader(sql, params);
         if (!reader->read())
             throw fourdberr("values.getValue fails to find record with ID = " + std::to_string(id));
         bool isNumeric = reader->getBoolean(0);
         if (isNumeric)
             return reader->getDouble(1);
         else
-            return reader->getString(2);
+            return std::string(reader->getStringUtf8(2));
     }
 
     int64_t values::getIdSelect(db& db, const strnum& value)
@@ -83,22 +369,20 @@ namespace fourdb
         {
             paramap params{ { L"@stringValue", value } };
             std::wstring insertSql =
-                L"INSERT INTO bvalues (isNumeric, numberValue, stringValue) VALUES (0, 0.0, @stringValue)";
-            int64_t id = db.execInsert(insertSql, params);
-
-            params.insert({ L"@id", static_cast<double>(id) });
-            std::wstring textInsertSearchSql =
-                L"INSERT INTO bvaluetext (valueid, stringSearchValue) VALUES (@id, @stringValue)";
-            db.execInsert(textInsertSearchSql, params);
-
+                L"INSERT INTO bvalues (isNumeric, numberValue, stringValue) VALUES (0, 0.0, @stringValue) "
+                L"ON CONFLICT(stringValue, numberValue, isNumeric) DO NOTHING "
+                L"RETURNING id";
+            int64_t id = db.execScalarInt64(insertSql, params).value_or(-1);
             return id;
         }
         else
         {
             paramap params{ { L"@numberValue", value } };
             std::wstring insertSql =
-                L"INSERT INTO bvalues (isNumeric, numberValue, stringValue) VALUES (1, @numberValue, '')";
-            int64_t id = db.execInsert(insertSql, params);
+                L"INSERT INTO bvalues (isNumeric, numberValue, stringValue) VALUES (1, @numberValue, '') "
+                L"ON CONFLICT(stringValue, numberValue, isNumeric) DO NOTHING "
+                L"RETURNING id";
+            int64_t id = db.execScalarInt64(insertSql, params).value_or(-1);
             return id;
         }
     }
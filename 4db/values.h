@@ -12,14 +12,95 @@ namespace fourdb
     public:
         static const wchar_t** createSql();
 
+        /// <summary>
+        /// Schema added since databases were first being created, run when opening one from before it,
+        /// see ctxt::SCHEMA_VERSION
+        /// </summary>
+        static const wchar_t** upgradeSql();
+
         static void reset(db& db);
 
         static int64_t getId(db& db, const strnum& value);
 
+        /// <summary>
+        /// Get IDs for many values at once, adding the ones that do not exist
+        /// Existing values are found with one join against a temp table of the values,
+        /// and missing values are added with one INSERT...SELECT
+        /// Best run inside a transaction
+        /// </summary>
+        /// <returns>Map from each of the values to its ID</returns>
+        static std::unordered_map<strnum, int64_t> getIds(db& db, const std::vector<strnum>& values);
+
         static strnum getValue(db& db, int64_t id);
 
+        /// <summary>
+        /// Load values into the temp.valuebatch table, idx being the index into values,
+        /// for joining against bvalues on (stringValue, numberValue, isNumeric)
+        /// Whatever was in the table before is cleared out
+        /// </summary>
+        static void loadValueBatch(db& db, const std::vector<strnum>& values);
+
+        /// <summary>
+        /// Delete the values with IDs in (afterId, upToId] that no row or column data refers to
+        /// Call items::ensureValueIndex first, or finding the references scans all the column data
+        /// </summary>
+        /// <returns>How many values were deleted</returns>
+        static int deleteOrphans(db& db, int64_t afterId, int64_t upToId);
+
+        /// <summary>
+        /// Each searchable column has its own full-text index table of its string values,
+        /// keyed by value ID; name ID 0 is for the row key
+        /// </summary>
+        static std::wstring getTextTableName(int tableId, int nameId);
+
+        /// <summary>
+        /// Get the (table ID, name ID) of the searchable columns
+        /// </summary>
+        static std::vector<std::pair<int, int>> getSearchColumns(db& db);
+
+        static bool isSearchable(db& db, int tableId, int nameId);
+
+        /// <summary>
+        /// Make a column searchable, creating its full-text index and indexing what's there already
+        /// Reload the catalog afterwards
+        /// </summary>
+        static void addSearch(db& db, int tableId, int nameId);
+
+        /// <summary>
+        /// Make a column not searchable, dropping its full-text index
+        /// Reload the catalog afterwards
+        /// </summary>
+        static void removeSearch(db& db, int tableId, int nameId);
+
+        /// <summary>
+        /// Add values of a searchable column to its full-text index, skipping numbers and what's there already
+        /// </summary>
+        static void addText(db& db, int tableId, int nameId, const std::vector<int64_t>& valueIds);
+
+        /// <summary>
+        /// Delete the full-text entries with value IDs in (afterId, upToId] that the column no longer has
+        /// </summary>
+        /// <returns>How many entries were deleted</returns>
+        static int deleteStaleText(db& db, int tableId, int nameId, int64_t afterId, int64_t upToId);
+
+        /// <summary>
+        /// Merge the full-text indexes down for faster searching
+        /// </summary>
+        static void optimizeText(db& db);
+
+        /// <summary>
+        /// Databases from before full-text indexing was by column have all their string values
+        /// in one bvaluetext table, so every string column and key could be searched;
+        /// make them all searchable, then drop the old table
+        /// Run with the upgradeSql, reload the catalog afterwards
+        /// </summary>
+        static void upgradeText(db& db);
+
+        // below this many values, one at a time beats setting up the temp table
+        static const size_t MIN_BATCH_SIZE = 16;
+
     private:
         static int64_t getIdSelect(db& db, const strnum& value);
-        static int64_t getIdInsert(db& db, const strnum& value);
+        static int64_t getIdInsert(db& db, const strnum& value); // -1 if it's already there
     };
 }
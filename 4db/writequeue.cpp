@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "writequeue.h"
+
+namespace fourdb
+{
+    writequeue::writequeue(db& db, std::mutex& writeMutex, std::chrono::milliseconds window, std::function<void()> onRollback)
+        : m_db(db)
+        , m_writeMutex(writeMutex)
+        , m_window(window)
+        , m_onRollback(onRollback)
+        , m_stopping(false)
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    writequeue::~writequeue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_stopping = true;
+        }
+        m_queueCond.notify_one();
+        m_thread.join();
+    }
+
+    std::future<void> writequeue::enqueue(operation op)
+    {
+        pendingop pending;
+        pending.op = op;
+        std::future<void> retVal = pending.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (m_stopping)
+                throw fourdberr("Write queue is stopping");
+            m_queue.push_back(std::move(pending));
+        }
+        m_queueCond.notify_one();
+        return retVal;
+    }
+
+    void writequeue::run()
+    {
+        std::vector<pendingop> batch;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_queueMutex);
+                m_queueCond.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) // stopping, and nothing left to do
+                    break;
+
+                // Give the rest of the batch a chance to show up
+                if (!m_stopping)
+                {
+                    auto deadline = std::chrono::steady_clock::now() + m_window;
+                    m_queueCond.wait_until(lock, deadline, [this]() { return m_stopping || m_queue.size() >= MAX_BATCH_SIZE; });
+                }
+
+                batch.swap(m_queue);
+            }
+
+            writeBatch(batch);
+            batch.clear();
+        }
+    }
+
+    void writequeue::writeBatch(std::vector<pendingop>& batch)
+    {
+        std::vector<std::exception_ptr> errors(batch.size());
+        std::unique_lock<std::mutex> lock(m_writeMutex);
+        try
+        {
+            m_db.execSql(L"BEGIN");
+            try
+            {
+                for (size_t idx = 0; idx < batch.size(); ++idx)
+                {
+                    m_db.execSql(L"SAVEPOINT writequeue");
+                    try
+                    {
+                        batch[idx].op();
+                        m_db.execSql(L"RELEASE writequeue");
+                    }
+                    catch (...)
+                    {
+                        errors[idx] = std::current_exception();
+                        m_db.execSql(L"ROLLBACK TO writequeue");
+                        m_db.execSql(L"RELEASE writequeue");
+
+                        // Before the next operation can use what this one added
+                        m_onRollback();
+                    }
+                }
+                m_db.execSql(L"COMMIT");
+            }
+            catch (...)
+            {
+                m_db.execSql(L"ROLLBACK");
+                throw;
+            }
+        }
+        catch (...)
+        {
+            // The whole batch is lost
+            m_onRollback();
+            lock.unlock();
+            for (auto& pending : batch)
+                pending.promise.set_exception(std::current_exception());
+            return;
+        }
+        lock.unlock();
+
+        for (size_t idx = 0; idx < batch.size(); ++idx)
+        {
+            if (errors[idx])
+                batch[idx].promise.set_exception(errors[idx]);
+            else
+                batch[idx].promise.set_value();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "db.h"
+
+namespace fourdb
+{
+    /// <summary>
+    /// Single-writer queue for group commit
+    /// Operations handed in from any thread are run by one background thread,
+    /// and everything that arrives within the commit window goes into one transaction
+    /// Each operation gets its own savepoint, so one failure does not sink the rest
+    /// </summary>
+    class writequeue
+    {
+    public:
+        typedef std::function<void()> operation;
+
+        /// <param name="db">Writer connection the operations run against</param>
+        /// <param name="writeMutex">Held while a batch is being written</param>
+        /// <param name="window">How long to gather operations before committing</param>
+        /// <param name="onRollback">Called after any rollback with writeMutex held, for clearing caches that may have gotten ahead of the database</param>
+        writequeue(db& db, std::mutex& writeMutex, std::chrono::milliseconds window, std::function<void()> onRollback);
+
+        /// <summary>
+        /// Writes out whatever is queued up, then stops the writer thread
+        /// </summary>
+        ~writequeue();
+
+        /// <summary>
+        /// Queue up an operation
+        /// </summary>
+        /// <returns>future that is ready once the operation's transaction is committed</returns>
+        std::future<void> enqueue(operation op);
+
+    private:
+        struct pendingop
+        {
+            operation op;
+            std::promise<void> promise;
+        };
+
+        void run();
+        void writeBatch(std::vector<pendingop>& batch);
+
+    private:
+        db& m_db;
+        std::mutex& m_writeMutex;
+        std::chrono::milliseconds m_window;
+        std::function<void()> m_onRollback;
+
+        std::mutex m_queueMutex;
+        std::condition_variable m_queueCond;
+        std::vector<pendingop> m_queue;
+        bool m_stopping;
+
+        std::thread m_thread;
+
+        static const size_t MAX_BATCH_SIZE = 10000;
+    };
+}
@@ -0,0 +1,496 @@
+/// <summary>
+/// This program runs repeatable workloads against a scratch 4db database
+/// and prints throughput and latency percentiles as JSON, one run per table size
+/// Usage: 4dbbench [--rows 1000,10000,...] [--ops 10000] [--workloads parse,convert,keys,bulk,...] [--db bench.db]
+/// </summary>
+#include "ctxt.h"
+#pragma comment(lib, "4db")
+
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+
+using namespace fourdb;
+
+const char* ALL_WORKLOADS = "parse,convert,keys,bulk,single,lookup,query,delete,drop,compact";
+
+/// <summary>
+/// Timings for one workload, one sample per operation, or per batch of operations
+/// </summary>
+struct result
+{
+    std::string workload;
+    size_t rows = 0; // rows in the table
+    size_t ops = 0; // operations performed, rows for the batched workloads
+    double seconds = 0.0;
+    std::vector<double> latencies; // microseconds per sample
+};
+
+class stopwatch
+{
+public:
+    stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+
+    double micros() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+double percentile(const std::vector<double>& sorted, double pct)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t idx = static_cast<size_t>(pct / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void printResult(result& res, bool first)
+{
+    std::sort(res.latencies.begin(), res.latencies.end());
+    double opsPerSec = res.seconds > 0.0 ? static_cast<double>(res.ops) / res.seconds : 0.0;
+    printf
+    (
+        "%s    {\"workload\": \"%s\", \"rows\": %u, \"ops\": %u, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+        "\"samples\": %u, \"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}}",
+        first ? "" : ",\n",
+        res.workload.c_str(),
+        static_cast<unsigned>(res.rows),
+        static_cast<unsigned>(res.ops),
+        res.seconds,
+        opsPerSec,
+        static_cast<unsigned>(res.latencies.size()),
+        percentile(res.latencies, 50.0),
+        percentile(res.latencies, 90.0),
+        percentile(res.latencies, 99.0),
+        res.latencies.empty() ? 0.0 : res.latencies.back()
+    );
+    fflush(stdout);
+}
+
+paramap rowData(size_t i)
+{
+    return paramap
+    {
+        { L"num", static_cast<double>(i) },
+        { L"name", L"name" + std::to_wstring(i % 1000) },
+        { L"bucket", static_cast<double>(i % 100) }
+    };
+}
+
+std::vector<std::string> split(const std::string& str)
+{
+    std::vector<std::string> retVal;
+    std::string cur;
+    for (char c : str)
+    {
+        if (c == ',')
+        {
+            if (!cur.empty())
+                retVal.push_back(cur);
+            cur.clear();
+        }
+        else
+            cur += c;
+    }
+    if (!cur.empty())
+        retVal.push_back(cur);
+    return retVal;
+}
+
+result benchParse(size_t ops)
+{
+    result res;
+    res.workload = "parse";
+    const wchar_t* query =
+        L"SELECT value, num, name "
+        L"FROM bench "
+        L"WHERE num >= @lo AND num < @hi AND name = @name "
+        L"ORDER BY num DESC "
+        L"LIMIT 100";
+    stopwatch total;
+    for (size_t op = 0; op < ops; ++op)
+    {
+        stopwatch sw;
+        auto select = sql::parse(query);
+        res.latencies.push_back(sw.micros());
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+// Time a function over and over, one sample per call
+result benchFunc(const char* workload, size_t ops, const std::function<void(size_t)>& func)
+{
+    result res;
+    res.workload = workload;
+    stopwatch total;
+    for (size_t op = 0; op < ops; ++op)
+    {
+        stopwatch sw;
+        func(op);
+        res.latencies.push_back(sw.micros());
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+// The conversion helpers in core, next to the standard library ones they replaced
+std::vector<result> benchConvert(size_t ops)
+{
+    const std::string utf8 = 
+        "SELECT value, num, name FROM bench WHERE name = 'caf\xC3\xA9 na\xC3\xAFve r\xC3\xA9sum\xC3\xA9' "
+        "AND num >= 1234 ORDER BY num DESC LIMIT 100";
+    const std::wstring wide = toWideStr(utf8);
+
+    size_t sink = 0; // keep the optimizer honest
+    std::vector<result> results;
+    results.push_back(benchFunc("convert_towide", ops, [&](size_t) { sink += toWideStr(utf8).size(); }));
+    results.push_back(benchFunc("convert_towide_codecvt", ops, [&](size_t) 
+    { 
+        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+        sink += converter.from_bytes(utf8).size();
+    }));
+    results.push_back(benchFunc("convert_tonarrow", ops, [&](size_t) { sink += toNarrowStr(wide).size(); }));
+    results.push_back(benchFunc("convert_tonarrow_codecvt", ops, [&](size_t) 
+    { 
+        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+        sink += converter.to_bytes(wide).size();
+    }));
+    results.push_back(benchFunc("convert_num2str", ops, [&](size_t op) { sink += num2str(static_cast<double>(op) * 1.25).size(); }));
+    results.push_back(benchFunc("convert_num2str_wstringstream", ops, [&](size_t op) 
+    { 
+        std::wstringstream ss;
+        ss << static_cast<double>(op) * 1.25;
+        sink += ss.str().size();
+    }));
+    if (sink == 0)
+        throw std::runtime_error("nothing converted");
+    return results;
+}
+
+// Builds the primary key => column data map that bulk define takes, no database involved
+result benchKeys(size_t rows)
+{
+    result res;
+    res.workload = "keys";
+    res.rows = rows;
+
+    const size_t batchSize = 10000;
+    stopwatch total;
+    for (size_t start = 0; start < rows; start += batchSize)
+    {
+        size_t end = std::min(rows, start + batchSize);
+        stopwatch sw;
+        std::unordered_map<strnum, paramap> batch;
+        for (size_t i = start; i < end; ++i)
+        {
+            batch.insert({ static_cast<double>(i), paramap() });
+            batch.insert({ std::string("key") + std::to_string(i), paramap() });
+        }
+        res.latencies.push_back(sw.micros() / static_cast<double>(end - start) / 2.0);
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = rows * 2;
+    return res;
+}
+
+// Loads the table that the workloads after it work against
+result benchBulk(ctxt& context, size_t rows)
+{
+    result res;
+    res.workload = "bulk";
+    res.rows = rows;
+
+    const size_t batchSize = 10000;
+    stopwatch total;
+    for (size_t start = 0; start < rows; start += batchSize)
+    {
+        std::unordered_map<strnum, paramap> batch;
+        size_t end = std::min(rows, start + batchSize);
+        for (size_t i = start; i < end; ++i)
+            batch.insert({ static_cast<double>(i), rowData(i) });
+
+        stopwatch sw;
+        context.define(L"bench", batch, [](const wchar_t*) {});
+        res.latencies.push_back(sw.micros() / static_cast<double>(end - start));
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = rows;
+    return res;
+}
+
+result benchSingle(ctxt& context, size_t rows, size_t ops)
+{
+    result res;
+    res.workload = "single";
+    res.rows = rows;
+
+    // Rows past the bulk-loaded ones, the drop workload cleans them up
+    stopwatch total;
+    for (size_t op = 0; op < ops; ++op)
+    {
+        size_t i = rows + op;
+        stopwatch sw;
+        context.define(L"bench", static_cast<double>(i), rowData(i));
+        res.latencies.push_back(sw.micros());
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+result benchLookup(ctxt& context, size_t rows, size_t ops, std::mt19937_64& rng)
+{
+    result res;
+    res.workload = "lookup";
+    res.rows = rows;
+
+    std::uniform_int_distribution<size_t> dist(0, rows - 1);
+    stopwatch total;
+    for (size_t op = 0; op < ops; ++op)
+    {
+        double key = static_cast<double>(dist(rng));
+        stopwatch sw;
+        int64_t rowId = context.getRowId(L"bench", key);
+        res.latencies.push_back(sw.micros());
+        if (rowId < 0)
+            throw std::runtime_error("lookup did not find row");
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+result benchQuery(ctxt& context, size_t rows, size_t ops, std::mt19937_64& rng)
+{
+    result res;
+    res.workload = "query";
+    res.rows = rows;
+
+    auto select =
+        sql::parse
+        (
+            L"SELECT value, num, name "
+            L"FROM bench "
+            L"WHERE num >= @lo AND num < @hi AND bucket = @bucket "
+            L"ORDER BY num DESC "
+            L"LIMIT 10"
+        );
+    std::uniform_int_distribution<size_t> dist(0, rows - 1);
+    stopwatch total;
+    for (size_t op = 0; op < ops; ++op)
+    {
+        size_t lo = dist(rng);
+        select.cmdParams.clear();
+        select.addParam(L"@lo", static_cast<double>(lo));
+        select.addParam(L"@hi", static_cast<double>(lo + 1000));
+        select.addParam(L"@bucket", static_cast<double>(lo % 100));
+
+        stopwatch sw;
+        auto reader = context.execQuery(select);
+        while (reader->read())
+        {
+        }
+        reader.reset();
+        res.latencies.push_back(sw.micros());
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+result benchDelete(ctxt& context, size_t rows, size_t ops)
+{
+    result res;
+    res.workload = "delete";
+    res.rows = rows;
+
+    // Take rows off the top, in batches
+    const size_t batchSize = 100;
+    ops = std::min(ops, rows);
+    stopwatch total;
+    for (size_t deleted = 0; deleted < ops; deleted += batchSize)
+    {
+        std::vector<strnum> keys;
+        for (size_t i = deleted; i < std::min(ops, deleted + batchSize); ++i)
+            keys.push_back(static_cast<double>(rows - 1 - i));
+
+        stopwatch sw;
+        context.deleteRows(L"bench", keys);
+        res.latencies.push_back(sw.micros() / static_cast<double>(keys.size()));
+    }
+    res.seconds = total.micros() / 1e6;
+    res.ops = ops;
+    return res;
+}
+
+result benchDrop(ctxt& context, size_t rows)
+{
+    result res;
+    res.workload = "drop";
+    res.rows = rows;
+
+    stopwatch sw;
+    context.drop(L"bench");
+    res.latencies.push_back(sw.micros());
+    res.seconds = res.latencies.back() / 1e6;
+    res.ops = 1;
+    return res;
+}
+
+// Clears out the values the delete and drop workloads left behind, 10 ms at a time
+result benchCompact(ctxt& context, size_t rows)
+{
+    result res;
+    res.workload = "compact";
+    res.rows = rows;
+
+    stopwatch total;
+    while (true)
+    {
+        stopwatch sw;
+        auto stats = context.compact(std::chrono::milliseconds(10));
+        res.latencies.push_back(sw.micros());
+        res.ops += static_cast<size_t>(stats.valuesRemoved);
+        if (stats.finished)
+            break;
+    }
+    res.seconds = total.micros() / 1e6;
+    return res;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::vector<size_t> rowCounts{ 1000, 10000, 100000 };
+        size_t ops = 10000;
+        std::string workloadsStr = ALL_WORKLOADS;
+        std::string dbFilePath = "4dbbench.db";
+        for (int a = 1; a < argc; ++a)
+        {
+            std::string arg = argv[a];
+            if (arg == "--help" || arg == "-h" || a + 1 >= argc)
+            {
+                fprintf(stderr, "Usage: 4dbbench [--rows 1000,10000,...] [--ops 10000] [--workloads %s] [--db 4dbbench.db]\n", ALL_WORKLOADS);
+                return arg == "--help" || arg == "-h" ? 0 : 1;
+            }
+
+            std::string val = argv[++a];
+            if (arg == "--rows")
+            {
+                rowCounts.clear();
+                for (const auto& count : split(val))
+                    rowCounts.push_back(static_cast<size_t>(std::stod(count))); // take 1e6 and the like
+            }
+            else if (arg == "--ops")
+                ops = static_cast<size_t>(std::stod(val));
+            else if (arg == "--workloads")
+                workloadsStr = val;
+            else if (arg == "--db")
+                dbFilePath = val;
+            else
+            {
+                fprintf(stderr, "ERROR: Unknown argument: %s\n", arg.c_str());
+                return 1;
+            }
+        }
+
+        std::unordered_set<std::string> workloads;
+        for (const auto& workload : split(workloadsStr))
+            workloads.insert(workload);
+        auto runs = [&workloads](const char* workload) { return workloads.find(workload) != workloads.end(); };
+
+        // Same keys, same queries, every time
+        std::mt19937_64 rng(4);
+
+        printf("{\n  \"results\": [\n");
+        bool first = true;
+
+        if (runs("parse"))
+        {
+            auto res = benchParse(ops);
+            printResult(res, first);
+            first = false;
+        }
+
+        if (runs("convert"))
+        {
+            for (auto& res : benchConvert(ops))
+            {
+                printResult(res, first);
+                first = false;
+            }
+        }
+
+        for (size_t rows : rowCounts)
+        {
+            if (rows == 0)
+                continue;
+
+            for (const char* suffix : { "", "-wal", "-shm" })
+            {
+                std::string path = dbFilePath + suffix;
+                if (std::filesystem::exists(path))
+                    std::filesystem::remove(path);
+            }
+            ctxt context(dbFilePath);
+
+            std::vector<result> results;
+
+            if (runs("keys"))
+                results.push_back(benchKeys(rows));
+
+            // Everything else needs the data, so it always gets loaded
+            results.push_back(benchBulk(context, rows));
+            if (!runs("bulk"))
+                results.pop_back();
+
+            if (runs("single"))
+                results.push_back(benchSingle(context, rows, ops));
+
+            if (runs("lookup"))
+                results.push_back(benchLookup(context, rows, ops, rng));
+
+            if (runs("query"))
+                results.push_back(benchQuery(context, rows, ops, rng));
+
+            if (runs("delete"))
+                results.push_back(benchDelete(context, rows, ops));
+
+            if (runs("drop"))
+                results.push_back(benchDrop(context, rows));
+
+            if (runs("compact"))
+                results.push_back(benchCompact(context, rows));
+
+            for (auto& res : results)
+            {
+                printResult(res, first);
+                first = false;
+            }
+        }
+
+        printf("\n  ]\n}\n");
+
+        for (const char* suffix : { "", "-wal", "-shm" })
+        {
+            std::string path = dbFilePath + suffix;
+            if (std::filesystem::exists(path))
+                std::filesystem::remove(path);
+        }
+        return 0;
+    }
+    catch (const std::exception& exp)
+    {
+        fprintf(stderr, "ERROR: %s\n", exp.what());
+        return 1;
+    }
+}
@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "catalog.h"
+#include "ctxt.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace fourdb
+{
+	TEST_CLASS(CatalogTests)
+	{
+	public:
+		TEST_METHOD(TestCatalog)
+		{
+			try
+			{
+				const char* testDbFilePath = "catalog_unit_tests.db";
+				if (std::filesystem::exists(testDbFilePath))
+					std::filesystem::remove(testDbFilePath);
+				const char* otherDbFilePath = "catalog_other_unit_tests.db";
+				if (std::filesystem::exists(otherDbFilePath))
+					std::filesystem::remove(otherDbFilePath);
+
+				int64_t version = -1;
+				{
+					ctxt context(testDbFilePath);
+					catalog* schemaCatalog = context.db().getCatalog();
+					Assert::IsTrue(schemaCatalog != nullptr);
+					Assert::IsTrue(schemaCatalog->current()->tables.empty());
+
+					paramap metadata{ { L"blet", toWideStr("monkey") }, { L"num", 914 } };
+					context.define(L"foo", toWideStr("bar"), metadata);
+
+					auto snapshot = schemaCatalog->current();
+					Assert::AreEqual(size_t(1), snapshot->tables.size());
+					Assert::AreEqual(size_t(2), snapshot->names.size());
+					int tableId = snapshot->tableIds.find(L"foo")->second;
+					int nameId = snapshot->nameIds.find(tableId)->second.find(L"num")->second;
+					Assert::IsTrue(snapshot->names.find(nameId)->second.isNumeric);
+					version = snapshot->version;
+
+					// Different file, different catalog
+					ctxt other(otherDbFilePath);
+					Assert::IsTrue(other.db().getCatalog() != schemaCatalog);
+					Assert::IsTrue(other.db().getCatalog()->current()->tables.empty());
+					Assert::AreEqual(-1, tables::getId(other.db(), L"foo", false, true, true));
+
+					// Old snapshots stay as they were
+					context.drop(L"foo");
+					Assert::IsTrue(schemaCatalog->current()->tables.empty());
+					Assert::AreEqual(size_t(1), snapshot->tables.size());
+					Assert::IsTrue(schemaCatalog->current()->version > version);
+				}
+
+				// The schema is loaded at open
+				{
+					ctxt context(testDbFilePath);
+					context.define(L"foo", toWideStr("bar"), paramap{ { L"blet", toWideStr("monkey") } });
+				}
+				{
+					ctxt context(testDbFilePath);
+					auto snapshot = context.db().getCatalog()->current();
+					Assert::AreEqual(size_t(1), snapshot->tables.size());
+					Assert::AreEqual(size_t(1), snapshot->names.size());
+					Assert::AreEqual(toWideStr("blet"), snapshot->names.begin()->second.name);
+				}
+
+				// Older databases get the newer schema once, after that opening doesn't touch it
+				int schemaVersion = -1;
+				{
+					ctxt context(testDbFilePath);
+					context.db().execSql(L"DROP INDEX idx_items_tableid");
+					context.db().execSql(L"PRAGMA user_version = 0");
+				}
+				{
+					ctxt context(testDbFilePath);
+					auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+					Assert::AreEqual(1, countOf(L"SELECT COUNT(*) FROM sqlite_master WHERE name = 'idx_items_tableid'"));
+					Assert::IsTrue(countOf(L"PRAGMA user_version") > 0);
+					schemaVersion = countOf(L"PRAGMA schema_version");
+				}
+				{
+					// Opening works while another connection is writing
+					fourdb::db writer(testDbFilePath);
+					writer.execSql(L"BEGIN IMMEDIATE");
+					ctxt context(testDbFilePath);
+					Assert::AreEqual(schemaVersion, context.db().execScalarInt32(L"PRAGMA schema_version").value());
+					Assert::AreEqual(size_t(1), context.db().getCatalog()->current()->tables.size());
+					writer.execSql(L"ROLLBACK");
+				}
+
+				// Opening an older database from many threads at once upgrades it once, and nobody fails
+				{
+					ctxt context(testDbFilePath);
+					context.db().execSql(L"DROP INDEX idx_items_tableid");
+					context.db().execSql(L"PRAGMA user_version = 0");
+				}
+				{
+					std::atomic<int> failures = 0;
+					std::vector<std::thread> threads;
+					for (int t = 0; t < 8; ++t)
+					{
+						threads.emplace_back([&]()
+						{
+							try { ctxt context(testDbFilePath); }
+							catch (const fourdberr&) { ++failures; }
+						});
+					}
+					for (auto& thread : threads)
+						thread.join();
+					Assert::AreEqual(0, failures.load());
+
+					ctxt context(testDbFilePath);
+					auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+					Assert::AreEqual(1, countOf(L"SELECT COUNT(*) FROM sqlite_master WHERE name = 'idx_items_tableid'"));
+					Assert::IsTrue(countOf(L"PRAGMA user_version") > 0);
+					Assert::AreEqual(size_t(1), context.db().getCatalog()->current()->tables.size());
+				}
+			}
+			catch (const std::runtime_error& exp)
+			{
+				Logger::WriteMessage(("Catalog Tests EXCEPTION: " + std::string(exp.what())).c_str());
+				throw;
+			}
+		}
+	};
+}
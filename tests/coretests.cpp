@@ -2,6 +2,7 @@
 #include "CppUnitTest.h"
 
 #include "core.h"
+#include "lrucache.h"
 #include "strnum.h"
 #include "vectormap.h"
 
@@ -38,6 +39,32 @@ namespace fourdb
 			Assert::AreEqual(toWideStr("1; 2; 3"), join(std::vector<std::wstring>{ L"1", L"2", L"3" }, L"; "));
 		}
 
+		TEST_METHOD(TestConversions)
+		{
+			// Long enough to go through the 8 bytes at a time ASCII path, with multi-byte in the middle
+			std::string utf8 = "ASCII before \xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80 and ASCII after";
+			std::wstring wide = toWideStr(utf8);
+			std::wstring expected = L"ASCII before \u00E9\u20AC\U0001F600 and ASCII after";
+			Assert::AreEqual(expected, wide);
+			Assert::AreEqual(utf8, toNarrowStr(wide));
+			Assert::AreEqual(std::string(), toNarrowStr(L""));
+			Assert::AreEqual(std::wstring(), toWideStr(""));
+
+			// Bad bytes, truncated sequences, and overlongs become U+FFFD
+			Assert::AreEqual(std::wstring(L"a\uFFFDb"), toWideStr("a\xFF" "b"));
+			Assert::AreEqual(std::wstring(L"a\uFFFDb"), toWideStr("a\xE2\x82" "b"));
+			Assert::AreEqual(std::wstring(L"\uFFFD/"), toWideStr("\xC0\xAF/"));
+			Assert::AreEqual(std::wstring(L"a\uFFFD"), toWideStr("a\xF0\x9F\x98"));
+
+			Assert::AreEqual(std::wstring(L"0"), num2str(0.0));
+			Assert::AreEqual(std::wstring(L"-12"), num2str(-12.0));
+			Assert::AreEqual(std::wstring(L"1234567890123"), num2str(1234567890123.0));
+			Assert::AreEqual(std::wstring(L"9.14"), num2str(9.14));
+			Assert::AreEqual(std::wstring(L"0.1"), num2str(0.1));
+			for (double num : { 0.1 + 0.2, 1.0 / 3.0, 6.02214076e23, -1.5e-300 })
+				Assert::AreEqual(num, std::wcstod(num2str(num).c_str(), nullptr));
+		}
+
 		TEST_METHOD(TestExtractParams)
 		{
 			{
@@ -92,6 +119,29 @@ namespace fourdb
 			Assert::IsTrue(numStr2.isStr());
 			Assert::AreEqual(std::wstring(L"blet 'monkey'"), numStr2.str());
 			Assert::AreEqual(std::wstring(L"'blet ''monkey'''"), numStr2.toSqlLiteral());
+
+			strnum utf8Str(std::string("caf\xC3\xA9"));
+			Assert::IsTrue(utf8Str.isStr());
+			Assert::AreEqual(std::string("caf\xC3\xA9"), utf8Str.utf8());
+			Assert::AreEqual(toWideStr("caf\xC3\xA9"), utf8Str.str());
+			Assert::IsTrue(utf8Str == strnum(toWideStr("caf\xC3\xA9")));
+			Assert::AreEqual(std::hash<strnum>()(utf8Str), std::hash<strnum>()(strnum(toWideStr("caf\xC3\xA9"))));
+
+			// Switching types through copies and moves
+			strnum switcher(1.0);
+			switcher = utf8Str;
+			Assert::IsTrue(switcher == utf8Str);
+			switcher = strnum(2.0);
+			Assert::AreEqual(2.0, switcher.num());
+			switcher = strnum(std::string("a string too long to fit in any small string buffer"));
+			strnum moved(std::move(switcher));
+			Assert::AreEqual(std::string("a string too long to fit in any small string buffer"), moved.utf8());
+			moved = numStr;
+			Assert::AreEqual(9.14, moved.num());
+
+			Assert::IsTrue(strnum(0.0) == strnum(-0.0));
+			Assert::AreEqual(std::hash<strnum>()(strnum(0.0)), std::hash<strnum>()(strnum(-0.0)));
+			Assert::IsTrue(!(strnum(1.0) == strnum(std::string("1"))));
 		}
 
 		TEST_METHOD(TestVectorMap)
@@ -130,5 +180,61 @@ namespace fourdb
 
 			Assert::IsTrue(!map.tryGet(2, val));
 		}
+
+		TEST_METHOD(TestLruCache)
+		{
+			lrucache<int, std::string> cache(2);
+			cache.put(0, "foo");
+			cache.put(1, "bar");
+			Assert::AreEqual(size_t(2), cache.size());
+
+			std::string val;
+			Assert::IsTrue(cache.tryGet(0, val)); // 0 is now most recent
+			Assert::AreEqual(std::string("foo"), val);
+
+			cache.put(2, "blet"); // out goes 1
+			Assert::AreEqual(size_t(2), cache.size());
+			Assert::IsTrue(!cache.tryGet(1, val));
+			Assert::IsTrue(cache.tryGet(0, val));
+			Assert::IsTrue(cache.tryGet(2, val));
+			Assert::AreEqual(std::string("blet"), val);
+
+			cache.put(2, "monkey");
+			Assert::IsTrue(cache.tryGet(2, val));
+			Assert::AreEqual(std::string("monkey"), val);
+
+			Assert::AreEqual(size_t(4), cache.hits());
+			Assert::AreEqual(size_t(1), cache.misses());
+
+			cache.setCapacity(1);
+			Assert::AreEqual(size_t(1), cache.size());
+			Assert::IsTrue(cache.tryGet(2, val));
+
+			cache.clear();
+			Assert::AreEqual(size_t(0), cache.size());
+			Assert::IsTrue(!cache.tryGet(2, val));
+
+			// The eviction hook keeps what it wants to, the rest go like before
+			std::vector<int> evicted;
+			lrucache<int, std::string> hooked(2, [&evicted](const int& key, std::string&)
+			{
+				if (key == 0)
+					return false;
+				evicted.push_back(key);
+				return true;
+			});
+			hooked.put(0, "foo");
+			hooked.put(1, "bar");
+			hooked.put(2, "blet"); // 0 is least recent but kept, out goes 1
+			Assert::AreEqual(size_t(2), hooked.size());
+			Assert::IsTrue(hooked.tryGet(0, val));
+			Assert::IsTrue(!hooked.tryGet(1, val));
+			Assert::IsTrue((std::vector<int>{ 1 }) == evicted);
+
+			hooked.clear();
+			Assert::AreEqual(size_t(1), hooked.size());
+			Assert::IsTrue(hooked.tryGet(0, val));
+			Assert::IsTrue((std::vector<int>{ 1, 2 }) == evicted);
+		}
 	};
 }
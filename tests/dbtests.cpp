@@ -98,5 +98,99 @@ namespace fourdb
 				throw;
 			}
 		}
+
+		TEST_METHOD(TestDbStatementCache)
+		{
+			try
+			{
+				const char* testDbFilePath = "db_cache_unit_tests.db";
+				if (std::filesystem::exists(testDbFilePath))
+					std::filesystem::remove(testDbFilePath);
+				db my_db(testDbFilePath);
+
+				my_db.execSql(L"CREATE TABLE foo (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, num NUMBER NOT NULL, str TEXT NOT NULL)");
+
+				// Bound, not pasted, so quotes and full precision make the trip
+				for (int run = 1; run <= 3; ++run)
+				{
+					paramap insertParams
+					{
+						{ L"@num", 9.1415926535 + run },
+						{ L"@str", toWideStr("it's @num") }
+					};
+					my_db.execInsert(L"INSERT INTO foo (num, str) VALUES (@num, @str)", insertParams);
+				}
+
+				// Same SQL while reading from the same SQL
+				const wchar_t* selectSql = L"SELECT id, num, str FROM foo WHERE id >= @id ORDER BY id";
+				paramap outerParams{ { L"@id", 1 } };
+				auto outer = my_db.execReader(selectSql, outerParams);
+				int rowCount = 0;
+				while (outer->read())
+				{
+					++rowCount;
+					Assert::AreEqual(9.1415926535 + rowCount, outer->getDouble(1));
+					Assert::AreEqual(toWideStr("it's @num"), outer->getString(2));
+
+					paramap innerParams{ { L"@id", static_cast<double>(outer->getInt64(0)) } };
+					auto inner = my_db.execReader(selectSql, innerParams);
+					Assert::IsTrue(inner->read());
+					Assert::AreEqual(outer->getInt64(0), inner->getInt64(0));
+				}
+				Assert::AreEqual(3, rowCount);
+
+				my_db.clearStatementCache();
+				Assert::AreEqual(3, my_db.execScalarInt32(L"SELECT COUNT(*) FROM foo").value());
+
+				// Filling the cache past its limit leaves statements being read from alone
+				auto held = my_db.execReader(selectSql, outerParams);
+				Assert::IsTrue(held->read());
+				for (int s = 0; s < 300; ++s)
+					Assert::AreEqual(s, my_db.execScalarInt32(L"SELECT " + std::to_wstring(s)).value());
+				my_db.clearStatementCache();
+				Assert::IsTrue(held->read());
+				Assert::AreEqual(9.1415926535 + 2, held->getDouble(1));
+			}
+			catch (const std::runtime_error& exp)
+			{
+				Logger::WriteMessage(("DB Cache Tests EXCEPTION: " + std::string(exp.what())).c_str());
+				throw;
+			}
+		}
+
+		TEST_METHOD(TestDbReaderUtf8)
+		{
+			try
+			{
+				const char* testDbFilePath = "db_utf8_unit_tests.db";
+				if (std::filesystem::exists(testDbFilePath))
+					std::filesystem::remove(testDbFilePath);
+				db my_db(testDbFilePath);
+
+				my_db.execSql(L"CREATE TABLE foo (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, num NUMBER NOT NULL, str TEXT NULL)");
+				my_db.execInsert(L"INSERT INTO foo (num, str) VALUES (@num, @str)", paramap{ { L"@num", 42 }, { L"@str", toWideStr("caf\xC3\xA9") } });
+				my_db.execSql(L"INSERT INTO foo (num, str) VALUES (43, NULL)");
+
+				auto reader = my_db.execReader(L"SELECT num, str AS blet FROM foo ORDER BY id");
+				Assert::AreEqual(std::string("blet"), std::string(reader->getColNameUtf8(1)));
+				Assert::AreEqual(toWideStr("blet"), reader->getColName(1));
+				Assert::AreEqual(toWideStr("num"), reader->getColName(0));
+
+				Assert::IsTrue(reader->read());
+				Assert::AreEqual(std::string("caf\xC3\xA9"), std::string(reader->getStringUtf8(1)));
+				Assert::AreEqual(std::string("42"), std::string(reader->getStringUtf8(0)));
+
+				Assert::IsTrue(reader->read());
+				Assert::IsTrue(reader->getStringUtf8(1).empty());
+				Assert::IsTrue(reader->isNull(1));
+
+				Assert::IsTrue(!reader->read());
+			}
+			catch (const std::runtime_error& exp)
+			{
+				Logger::WriteMessage(("DB UTF-8 Tests EXCEPTION: " + std::string(exp.what())).c_str());
+				throw;
+			}
+		}
 	};
 }
@@ -74,6 +74,56 @@ namespace fourdb
                     Assert::AreEqual(toWideStr("bletmonkey"), select.from);
                     Assert::AreEqual(1492, select.limit);
                 }
+
+                {
+                    auto select = sql::parse(L"SELECT foo, bar\nFROM bletmonkey\nLIMIT 10 OFFSET 20");
+                    Assert::AreEqual(10, select.limit);
+                    Assert::AreEqual(20, select.offset);
+                }
+
+                {
+                    auto select = sql::parse(L"SELECT foo\nFROM bletmonkey\nWHERE some IN (@a, @b,@c) AND (all = @x OR none BETWEEN @lo AND @hi) AND other IN @list");
+                    Assert::AreEqual(2U, select.where.size());
+                    Assert::IsTrue(select.where[0].combine == criteriaop::AND);
+                    Assert::AreEqual(2U, select.where[0].criterias.size());
+                    Assert::AreEqual(toWideStr("IN"), select.where[0].criterias[0].op);
+                    Assert::AreEqual(toWideStr("@a, @b, @c"), join(select.where[0].criterias[0].paramNames, L", "));
+                    Assert::AreEqual(toWideStr("@list"), select.where[0].criterias[1].paramName);
+                    Assert::IsTrue(select.where[1].combine == criteriaop::OR);
+                    Assert::AreEqual(2U, select.where[1].criterias.size());
+                    Assert::AreEqual(toWideStr("BETWEEN"), select.where[1].criterias[1].op);
+                    Assert::AreEqual(toWideStr("@lo, @hi"), join(select.where[1].criterias[1].paramNames, L", "));
+                }
+
+                {
+                    bool threw = false;
+                    try { sql::parse(L"SELECT foo FROM bletmonkey WHERE (some = @a OR all = @b AND none = @c)"); }
+                    catch (const fourdberr&) { threw = true; }
+                    Assert::IsTrue(threw);
+                }
+
+                {
+                    auto select = sql::parse(L"SELECT genre,SUM(plays), COUNT(DISTINCT artist), count\nFROM bletmonkey\nWHERE year > @year\nGROUP BY genre\nORDER BY Sum( plays ) DESC LIMIT 5");
+                    Assert::AreEqual(toWideStr("genre, sum(plays), count(distinct artist), count"), join(select.selectCols, L", "));
+                    Assert::AreEqual(1U, select.where.size());
+                    Assert::AreEqual(toWideStr("genre"), join(select.groupBy, L", "));
+                    Assert::AreEqual(1U, select.orderBy.size());
+                    Assert::AreEqual(toWideStr("sum(plays)"), select.orderBy[0].field);
+                    Assert::AreEqual(true, select.orderBy[0].descending);
+                    Assert::AreEqual(5, select.limit);
+                }
+
+                {
+                    auto select = sql::parse(L"SELECT COUNT(*) FROM bletmonkey");
+                    Assert::AreEqual(toWideStr("count"), join(select.selectCols, L", "));
+                }
+
+                {
+                    bool threw = false;
+                    try { sql::parse(L"SELECT MEDIAN(plays) FROM bletmonkey"); }
+                    catch (const fourdberr&) { threw = true; }
+                    Assert::IsTrue(threw);
+                }
             }
             catch (const std::runtime_error& exp)
             {
@@ -91,5 +91,1033 @@ namespace fourdb
                 throw;
             }
         }
+
+        TEST_METHOD(TestSqlPooledReads)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_pooled_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true, true);
+
+                for (int n = 1; n <= 10; ++n)
+                {
+                    paramap metadata{ { L"num", n } };
+                    context.define(L"pooled", n, metadata);
+                }
+
+                // Readers on different threads, each holding a reader open while querying again
+                std::atomic<int> matches = 0;
+                std::vector<std::thread> threads;
+                for (int t = 0; t < 4; ++t)
+                {
+                    threads.emplace_back([&context, &matches]()
+                    {
+                        auto select = sql::parse(L"SELECT value, num FROM pooled ORDER BY value");
+                        auto reader = context.execQuery(select);
+                        while (reader->read())
+                        {
+                            double key = reader->getDouble(0);
+                            if (context.getRowId(L"pooled", key) >= 0 && reader->getDouble(1) == key)
+                                ++matches;
+                        }
+                    });
+                }
+                for (auto& thread : threads)
+                    thread.join();
+                Assert::AreEqual(40, matches.load());
+
+                // Writes are seen by subsequent reads
+                context.deleteRow(L"pooled", 1.0);
+                auto countSelect = sql::parse(L"SELECT count FROM pooled");
+                Assert::AreEqual(int64_t(9), context.execScalarInt64(countSelect).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Pooled Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlDefineStream)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_stream_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                // Generator, committing every 7 rows
+                int next = 0;
+                int progressCount = 0;
+                context.defineStream
+                (
+                    L"streamed",
+                    [&next](strnum& key, paramap& columnData)
+                    {
+                        if (next >= 100)
+                            return false;
+                        key = next;
+                        columnData.insert({ L"half", next / 2 });
+                        columnData.insert({ L"name", L"row" + std::to_wstring(next) });
+                        ++next;
+                        return true;
+                    },
+                    [&progressCount](const wchar_t*) { ++progressCount; },
+                    7
+                );
+                Assert::AreEqual(15, progressCount); // 14 chunks + final
+
+                auto countSelect = sql::parse(L"SELECT count FROM streamed");
+                Assert::AreEqual(int64_t(100), context.execScalarInt64(countSelect).value());
+
+                // Range, overwriting some rows
+                std::vector<std::pair<strnum, paramap>> rows;
+                for (int n = 90; n < 110; ++n)
+                    rows.push_back({ n, paramap{ { L"half", -1 } } });
+                context.defineStream(L"streamed", rows.begin(), rows.end(), [](const wchar_t*) {}, 3);
+                Assert::AreEqual(int64_t(110), context.execScalarInt64(countSelect).value());
+
+                auto select = sql::parse(L"SELECT half, name FROM streamed WHERE value = @value");
+                select.addParam(L"@value", 95.0);
+                auto reader = context.execQuery(select);
+                Assert::IsTrue(reader->read());
+                Assert::AreEqual(-1.0, reader->getDouble(0));
+                Assert::AreEqual(toWideStr("row95"), reader->getString(1));
+
+                // Mixed key types fail, earlier chunks stay
+                std::vector<std::pair<strnum, paramap>> badRows
+                {
+                    { 200.0, paramap{ { L"half", 100 } } },
+                    { toWideStr("bad"), paramap{ { L"half", 100 } } }
+                };
+                try
+                {
+                    context.defineStream(L"streamed", badRows.begin(), badRows.end(), [](const wchar_t*) {}, 1);
+                    Assert::Fail();
+                }
+                catch (const fourdberr&) {}
+                Assert::AreEqual(int64_t(111), context.execScalarInt64(countSelect).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Stream Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlValueCache)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_valuecache_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                // Same makes over and over, only the first define has to look them up
+                for (int n = 0; n < 10; ++n)
+                {
+                    paramap metadata{ { L"make", toWideStr("Nissan") }, { L"year", 1987 } };
+                    context.define(L"cars", n, metadata);
+                }
+                auto stats = context.getValueCacheStats();
+                Assert::AreEqual(size_t(2), stats.misses);
+                Assert::AreEqual(size_t(18), stats.hits);
+                Assert::AreEqual(size_t(2), stats.size);
+
+                // Reset wipes out the values, and the cache with them
+                context.reset();
+                Assert::AreEqual(size_t(0), context.getValueCacheStats().size);
+
+                paramap metadata{ { L"make", toWideStr("Toyota") } };
+                context.define(L"cars", 1.0, metadata);
+                auto select = sql::parse(L"SELECT make FROM cars WHERE value = @value");
+                select.addParam(L"@value", 1.0);
+                Assert::AreEqual(toWideStr("Toyota"), context.execScalarString(select).value());
+
+                Assert::AreEqual(size_t(1), context.getValueCacheStats().size);
+
+                // Values compacted away by another connection are not used from the cache
+                {
+                    ctxt other(testDbFilePath);
+                    other.deleteRow(L"cars", 1.0);
+                    Assert::IsTrue(other.compact().valuesRemoved > 0);
+                }
+                context.define(L"cars", 2.0, metadata);
+                select.cmdParams.clear();
+                select.addParam(L"@value", 2.0);
+                Assert::AreEqual(toWideStr("Toyota"), context.execScalarString(select).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Value Cache Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlCompiledQueries)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_compiled_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                // Same shape, same key, whatever the parameter values
+                auto select1 = sql::parse(L"SELECT num FROM nums WHERE value = @value");
+                select1.addParam(L"@value", 1.0);
+                auto select2 = sql::parse(L"SELECT num\nFROM nums\nWHERE value = @value");
+                select2.addParam(L"@value", 2.0);
+                Assert::AreEqual(sql::getQueryKey(select1), sql::getQueryKey(select2));
+                Assert::AreNotEqual(sql::getQueryKey(select1), sql::getQueryKey(sql::parse(L"SELECT num FROM nums WHERE value > @value")));
+                Assert::AreNotEqual(sql::getQueryKey(select1), sql::getQueryKey(sql::parse(L"SELECT num FROM nums WHERE value = @value LIMIT 1")));
+
+                // Nothing there yet, so nothing found...
+                Assert::IsTrue(!context.execScalarDouble(select1).has_value());
+
+                // ...until there is
+                context.define(L"nums", 1.0, paramap{ { L"num", 10 } });
+                context.define(L"nums", 2.0, paramap{ { L"num", 20 } });
+                for (int run = 1; run <= 3; ++run)
+                {
+                    Assert::AreEqual(10.0, context.execScalarDouble(select1).value());
+                    Assert::AreEqual(20.0, context.execScalarDouble(select2).value());
+                }
+
+                // Schema changes are picked up
+                context.drop(L"nums");
+                Assert::IsTrue(!context.execScalarDouble(select1).has_value());
+                context.define(L"nums", 1.0, paramap{ { L"num", 100 } });
+                Assert::AreEqual(100.0, context.execScalarDouble(select1).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Compiled Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlUtf8)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_utf8_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                const std::string cafe = "caf\xC3\xA9";
+                context.define(L"drinks", std::string("latte"), paramap{ { L"place", cafe }, { L"price", 4.5 } });
+
+                auto select = sql::parse(std::string("SELECT place, price FROM drinks WHERE value = @value"));
+                select.addParam(L"@value", std::string("latte"));
+                {
+                    auto reader = context.execQuery(select);
+                    Assert::IsTrue(reader->read());
+                    Assert::AreEqual(cafe, std::string(reader->getStringUtf8(0)));
+                    Assert::AreEqual(toWideStr(cafe), reader->getString(0));
+                    Assert::AreEqual(4.5, reader->getDouble(1));
+                    Assert::IsTrue(!reader->read());
+                }
+                Assert::AreEqual(cafe, context.execScalarStringUtf8(select).value());
+
+                // Same value either way in
+                select.cmdParams.clear();
+                select.addParam(L"@value", toWideStr("latte"));
+                Assert::AreEqual(toWideStr(cafe), context.execScalarString(select).value());
+
+                int64_t rowId = context.getRowId(L"drinks", std::string("latte"));
+                Assert::AreEqual(std::string("latte"), context.getRowStringValueUtf8(L"drinks", rowId).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL UTF-8 Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlDeleteRows)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_delete_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 100; ++idx)
+                    rows.insert({ static_cast<double>(idx), paramap{ { L"num", idx * 10 }, { L"str", toWideStr("row" + std::to_string(idx)) } } });
+                context.define(L"deletes", rows, [](const wchar_t*) {});
+                context.define(L"others", 5.0, paramap{ { L"num", 50 } });
+
+                auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+                int valueCount = countOf(L"SELECT COUNT(*) FROM bvalues");
+                Assert::AreEqual(201, countOf(L"SELECT COUNT(*) FROM itemnamevalues"));
+
+                // Evens go, along with keys that are not there, which must not turn into values
+                std::vector<strnum> keys;
+                for (int idx = 0; idx < 100; idx += 2)
+                    keys.push_back(static_cast<double>(idx));
+                keys.push_back(1000.0);
+                keys.push_back(toWideStr("not a key"));
+                context.deleteRows(L"deletes", keys);
+
+                Assert::AreEqual(50 + 1, countOf(L"SELECT COUNT(*) FROM items"));
+                Assert::AreEqual(50 * 2 + 1, countOf(L"SELECT COUNT(*) FROM itemnamevalues"));
+                Assert::AreEqual(0, countOf(L"SELECT COUNT(*) FROM itemnamevalues WHERE itemid NOT IN (SELECT id FROM items)"));
+                Assert::AreEqual(valueCount, countOf(L"SELECT COUNT(*) FROM bvalues"));
+
+                auto select = sql::parse(L"SELECT num FROM deletes WHERE value = @value");
+                select.addParam(L"@value", 3.0);
+                Assert::AreEqual(30.0, context.execScalarDouble(select).value());
+                select.cmdParams.clear();
+                select.addParam(L"@value", 4.0);
+                Assert::IsTrue(!context.execScalarDouble(select).has_value());
+
+                // The same key in another table is left alone
+                context.deleteRows(L"deletes", std::vector<strnum>{ 5.0 });
+                Assert::AreEqual(50.0, context.execScalarDouble(sql::parse(L"SELECT num FROM others")).value());
+
+                // No such table, nothing doing, and no table made
+                context.deleteRows(L"nothere", keys);
+                Assert::AreEqual(2, countOf(L"SELECT COUNT(*) FROM tables"));
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Delete Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlCompact)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_compact_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 100; ++idx)
+                    rows.insert({ static_cast<double>(idx), paramap{ { L"str", toWideStr("before " + std::to_string(idx)) } } });
+                context.define(L"keepers", rows, [](const wchar_t*) {});
+                context.define(L"droppers", toWideStr("gone"), paramap{ { L"str", toWideStr("dropped value") } });
+                context.setSearchable(L"keepers", L"str");
+                context.setSearchable(L"droppers", L"str");
+
+                auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+                auto orphanCount = [&countOf]()
+                {
+                    return
+                        countOf
+                        (
+                            L"SELECT COUNT(*) FROM bvalues WHERE id NOT IN (SELECT valueid FROM items) "
+                            L"AND id NOT IN (SELECT valueid FROM itemnamevalues)"
+                        );
+                };
+                Assert::AreEqual(0, orphanCount());
+
+                // Overwrite half the strings, delete some rows, and drop a table, leaving values behind
+                for (int idx = 0; idx < 50; ++idx)
+                    context.define(L"keepers", static_cast<double>(idx), paramap{ { L"str", toWideStr("after " + std::to_string(idx)) } });
+                context.deleteRows(L"keepers", std::vector<strnum>{ 98.0, 99.0 });
+                context.drop(L"droppers");
+                int orphans = orphanCount();
+                Assert::AreEqual(50 + 2 + 2 + 2, orphans);
+
+                // A little at a time until it's made it through
+                int64_t removed = 0;
+                for (int run = 0; run < 100; ++run)
+                {
+                    auto stats = context.compact(std::chrono::milliseconds(0));
+                    removed += stats.valuesRemoved;
+                    Assert::IsTrue(stats.bytesReclaimed >= 0);
+                    if (stats.finished)
+                        break;
+                }
+                Assert::AreEqual(static_cast<int64_t>(orphans), removed);
+                Assert::AreEqual(0, orphanCount());
+                Assert::AreEqual(98, countOf(L"SELECT COUNT(*) FROM bvaluetext_1_1")); // one per row
+
+                // Full-text searches only find what's still around
+                auto countRows = [&context](const select& query)
+                {
+                    int count = 0;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        ++count;
+                    return count;
+                };
+                auto select = sql::parse(L"SELECT value FROM keepers WHERE str MATCHES @search");
+                select.addParam(L"@search", toWideStr("before"));
+                Assert::AreEqual(48, countRows(select));
+                select.cmdParams.clear();
+                select.addParam(L"@search", toWideStr("after"));
+                Assert::AreEqual(50, countRows(select));
+
+                // Removed values come back as new ones
+                context.define(L"keepers", 0.0, paramap{ { L"str", toWideStr("before 0") } });
+                auto getStr = sql::parse(L"SELECT str FROM keepers WHERE value = @value");
+                getStr.addParam(L"@value", 0.0);
+                Assert::AreEqual(toWideStr("before 0"), context.execScalarString(getStr).value());
+                Assert::AreEqual(1, orphanCount()); // "after 0"
+
+                auto stats = context.compact();
+                Assert::AreEqual(static_cast<int64_t>(1), stats.valuesRemoved);
+                Assert::IsTrue(stats.finished);
+                Assert::AreEqual(0, orphanCount());
+                Assert::AreEqual(98, countOf(L"SELECT COUNT(*) FROM bvaluetext_1_1")); // one per row
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Compact Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlIndexedWhere)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_indexed_where_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 200; ++idx)
+                {
+                    paramap row{ { L"num", idx }, { L"bucket", idx % 10 }, { L"name", toWideStr("name" + std::to_string(idx % 7)) } };
+                    if (idx % 5 == 0)
+                        row.erase(L"bucket"); // some rows without
+                    rows.insert({ static_cast<double>(idx), row });
+                }
+                context.define(L"indexed", rows, [](const wchar_t*) {});
+                context.define(L"others", 1.0, paramap{ { L"num", 50 }, { L"bucket", 3 } }); // same values, other table
+
+                auto countRows = [&context](select query)
+                {
+                    int count = 0;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        ++count;
+                    return count;
+                };
+
+                // Comparisons on the values are done from the value side
+                auto select = sql::parse(L"SELECT value, num FROM indexed WHERE num >= @lo AND num < @hi AND bucket = @bucket");
+                Assert::IsTrue(context.generateSql(select).find(L"i.id IN (SELECT itemid FROM itemnamevalues") != std::wstring::npos);
+                select.addParam(L"@lo", 20.0);
+                select.addParam(L"@hi", 60.0);
+                select.addParam(L"@bucket", 3.0);
+                Assert::AreEqual(4, countRows(select)); // 23, 33, 43, 53
+
+                // A column the rows don't all have
+                select = sql::parse(L"SELECT value FROM indexed WHERE bucket <= @bucket");
+                select.addParam(L"@bucket", 1.0);
+                Assert::AreEqual(20, countRows(select)); // the 0s are multiples of 5, so only the 1s
+
+                // Strings, and the row key
+                select = sql::parse(L"SELECT value FROM indexed WHERE name = @name AND value > @value");
+                select.addParam(L"@name", toWideStr("name3"));
+                select.addParam(L"@value", 100.0);
+                Assert::AreEqual(15, countRows(select)); // 101, 108, ..., 199
+                Assert::IsTrue(context.generateSql(select).find(L"i.valueid IN (SELECT id FROM bvalues") != std::wstring::npos);
+
+                // Mixed in with what the value indexes can't do
+                select = sql::parse(L"SELECT value FROM indexed WHERE name LIKE @name AND num < @num AND bucket <> @bucket");
+                select.addParam(L"@name", toWideStr("name1%"));
+                select.addParam(L"@num", 50.0);
+                select.addParam(L"@bucket", 8.0);
+                Assert::AreEqual(5, countRows(select)); // 1, 22, 29, 36, 43; 8 is in bucket 8 and 15 has no bucket
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Indexed Where Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlJoins)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_joins_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 50; ++idx)
+                {
+                    paramap row{ { L"num", idx }, { L"name", toWideStr("name" + std::to_string(idx)) } };
+                    if (idx % 2 == 0)
+                        row.insert({ L"bucket", idx % 10 });
+                    rows.insert({ static_cast<double>(idx), row });
+                }
+                context.define(L"joins", rows, [](const wchar_t*) {});
+                context.define(L"others", 1.0, paramap{ { L"num", 1 } });
+
+                auto countRows = [&context](select query)
+                {
+                    int count = 0;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        ++count;
+                    return count;
+                };
+
+                // Counting a table is just counting items
+                auto select = sql::parse(L"SELECT count FROM joins");
+                Assert::AreEqual(std::wstring(L"SELECT COUNT(*) AS count FROM items WHERE tableid = 1"), context.generateSql(select));
+                Assert::AreEqual(static_cast<int64_t>(50), context.execScalarInt64(select).value());
+                Assert::AreEqual(static_cast<int64_t>(0), context.execScalarInt64(sql::parse(L"SELECT count FROM nothere")).value());
+
+                // Columns only in the SELECT can be missing
+                select = sql::parse(L"SELECT value, bucket FROM joins");
+                Assert::IsTrue(context.generateSql(select).find(L"LEFT OUTER JOIN itemnamevalues AS invbucket") != std::wstring::npos);
+                Assert::AreEqual(50, countRows(select));
+
+                // Columns compared in the WHERE can't be
+                select = sql::parse(L"SELECT value, bucket FROM joins WHERE bucket <> @bucket");
+                Assert::IsTrue(context.generateSql(select).find(L"\nJOIN itemnamevalues AS invbucket") != std::wstring::npos);
+                select.addParam(L"@bucket", 4.0);
+                Assert::AreEqual(20, countRows(select));
+
+                // Columns only compared from the value side are not joined at all
+                select = sql::parse(L"SELECT name FROM joins WHERE num < @num AND value >= @value");
+                std::wstring sql = context.generateSql(select);
+                Assert::IsTrue(sql.find(L"invnum") == std::wstring::npos);
+                Assert::IsTrue(sql.find(L"JOIN bvalues bv") == std::wstring::npos);
+                select.addParam(L"@num", 20.0);
+                select.addParam(L"@value", 10.0);
+                Assert::AreEqual(10, countRows(select));
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Joins Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlSearch)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_search_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                context.define(L"books", toWideStr("b1"), paramap{ { L"title", toWideStr("the red fox") }, { L"year", 1999 } });
+                context.define(L"books", toWideStr("b2"), paramap{ { L"title", toWideStr("a blue fox") }, { L"note", toWideStr("fox") } });
+                context.define(L"movies", toWideStr("m1"), paramap{ { L"title", toWideStr("the red fox") } });
+
+                auto countRows = [&context](select query)
+                {
+                    int count = 0;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        ++count;
+                    return count;
+                };
+
+                // Not searchable until asked for
+                auto select = sql::parse(L"SELECT value FROM books WHERE title MATCHES @search");
+                select.addParam(L"@search", toWideStr("fox"));
+                bool threw = false;
+                try { countRows(select); }
+                catch (const fourdberr&) { threw = true; }
+                Assert::IsTrue(threw);
+
+                // Existing rows are indexed, and only the column's values are searched
+                context.setSearchable(L"books", L"title");
+                Assert::AreEqual(2, countRows(select));
+                select.cmdParams.clear();
+                select.addParam(L"@search", toWideStr("red"));
+                Assert::AreEqual(1, countRows(select));
+
+                // New rows too
+                context.define(L"books", toWideStr("b3"), paramap{ { L"title", toWideStr("red sky") } });
+                Assert::AreEqual(2, countRows(select));
+
+                // ORed with other comparisons, rows that only pass the others are kept
+                auto orSelect = sql::parse(L"SELECT value FROM books WHERE (title MATCHES @search OR year = @year)");
+                orSelect.addParam(L"@search", toWideStr("sky"));
+                orSelect.addParam(L"@year", 1999);
+                Assert::AreEqual(2, countRows(orSelect));
+
+                // Row keys can be searchable, numeric columns can't
+                context.setSearchable(L"movies", L"value");
+                auto keySelect = sql::parse(L"SELECT value FROM movies WHERE value MATCHES @search");
+                keySelect.addParam(L"@search", toWideStr("m1"));
+                Assert::AreEqual(1, countRows(keySelect));
+
+                threw = false;
+                try { context.setSearchable(L"books", L"year"); }
+                catch (const fourdberr&) { threw = true; }
+                Assert::IsTrue(threw);
+
+                // No longer searchable, and dropping a table drops its full-text indexes
+                context.setSearchable(L"books", L"title", false);
+                threw = false;
+                try { countRows(select); }
+                catch (const fourdberr&) { threw = true; }
+                Assert::IsTrue(threw);
+
+                context.setSearchable(L"books", L"note");
+                context.drop(L"books");
+                auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+                Assert::AreEqual(1, countOf(L"SELECT COUNT(*) FROM searchcolumns"));
+                Assert::AreEqual(1, countOf(L"SELECT COUNT(*) FROM sqlite_master WHERE sql LIKE 'CREATE VIRTUAL TABLE%'"));
+
+                // Databases from before searching was by column can still search every string column
+                const char* oldDbFilePath = "sql_search_upgrade_unit_tests.db";
+                if (std::filesystem::exists(oldDbFilePath))
+                    std::filesystem::remove(oldDbFilePath);
+                {
+                    ctxt oldContext(oldDbFilePath, true);
+                    oldContext.define(L"books", toWideStr("b1"), paramap{ { L"title", toWideStr("the red fox") }, { L"year", 1999 } });
+                    oldContext.db().execSql(L"DROP TABLE searchcolumns");
+                    oldContext.db().execSql(L"CREATE VIRTUAL TABLE bvaluetext USING fts5 (valueid, stringSearchValue)");
+                    oldContext.db().execSql(L"INSERT INTO bvaluetext (valueid, stringSearchValue) SELECT id, stringValue FROM bvalues WHERE isNumeric = 0");
+                    oldContext.db().execSql(L"PRAGMA user_version = 0");
+                }
+                {
+                    ctxt oldContext(oldDbFilePath);
+                    auto oldSelect = sql::parse(L"SELECT value FROM books WHERE title MATCHES @search");
+                    oldSelect.addParam(L"@search", toWideStr("fox"));
+                    auto reader = oldContext.execQuery(oldSelect);
+                    Assert::IsTrue(reader->read());
+                    Assert::AreEqual(std::string("b1"), toNarrowStr(reader->getString(0)));
+                    reader.reset();
+
+                    auto oldKeySelect = sql::parse(L"SELECT value FROM books WHERE value MATCHES @search");
+                    oldKeySelect.addParam(L"@search", toWideStr("b1"));
+                    reader = oldContext.execQuery(oldKeySelect);
+                    Assert::IsTrue(reader->read());
+                    reader.reset();
+
+                    Assert::AreEqual(0, oldContext.db().execScalarInt32(L"SELECT COUNT(*) FROM sqlite_master WHERE name = 'bvaluetext'").value());
+                }
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Search Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlColumnIndexes)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_column_indexes_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 100; ++idx)
+                    rows.insert({ static_cast<double>(idx), paramap{ { L"num", idx }, { L"name", toWideStr("name" + std::to_string(idx % 7)) } } });
+                context.define(L"indexes", rows, [](const wchar_t*) {});
+
+                auto getNums = [&context](select query)
+                {
+                    std::vector<int> nums;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        nums.push_back(static_cast<int>(reader->getDouble(1)));
+                    return nums;
+                };
+
+                // Existing rows are indexed, and the rows come in the index's order
+                context.createIndex(L"indexes", L"num");
+                auto select = sql::parse(L"SELECT value, num FROM indexes WHERE num >= @num ORDER BY num DESC LIMIT 3");
+                select.addParam(L"@num", 90.0);
+                Assert::IsTrue(context.generateSql(select).find(L"FROM\ncolumnindex_") != std::wstring::npos);
+                Assert::IsTrue(std::vector<int>{ 99, 98, 97 } == getNums(select));
+
+                // Comparisons without the ORDER BY seek the index
+                auto seekSelect = sql::parse(L"SELECT value, num FROM indexes WHERE num > @num AND name = @name");
+                seekSelect.addParam(L"@num", 90.0);
+                seekSelect.addParam(L"@name", toWideStr("name0"));
+                Assert::IsTrue(context.generateSql(seekSelect).find(L"i.id IN (SELECT itemid FROM columnindex_") != std::wstring::npos);
+                Assert::AreEqual(size_t(2), getNums(seekSelect).size()); // 91, 98
+
+                // Kept up with changes, removals, and deletes
+                context.define(L"indexes", 50.0, paramap{ { L"num", 1000 } });
+                context.undefine(L"indexes", 99.0, L"num");
+                context.deleteRows(L"indexes", { 98.0 });
+                Assert::IsTrue(std::vector<int>{ 1000, 97, 96 } == getNums(select));
+
+                // Without the index, same answer
+                context.dropIndex(L"indexes", L"num");
+                context.dropIndex(L"indexes", L"num");
+                Assert::IsTrue(context.generateSql(select).find(L"columnindex_") == std::wstring::npos);
+                Assert::IsTrue(std::vector<int>{ 1000, 97, 96 } == getNums(select));
+
+                // The column has to exist, and dropping a table drops its indexes
+                bool threw = false;
+                try { context.createIndex(L"indexes", L"nope"); }
+                catch (const fourdberr&) { threw = true; }
+                Assert::IsTrue(threw);
+
+                context.createIndex(L"indexes", L"name");
+                context.drop(L"indexes");
+                auto countOf = [&context](const wchar_t* sql) { return context.db().execScalarInt32(sql).value(); };
+                Assert::AreEqual(0, countOf(L"SELECT COUNT(*) FROM indexcolumns"));
+                Assert::AreEqual(0, countOf(L"SELECT COUNT(*) FROM sqlite_master WHERE name LIKE 'columnindex%'"));
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Column Indexes Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlKeyLookups)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_key_lookups_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 40; ++idx)
+                    rows.insert({ toWideStr("key" + std::to_string(idx)), paramap{ { L"num", idx } } });
+                context.define(L"strkeys", rows, [](const wchar_t*) {});
+                context.define(L"numkeys", 7.0, paramap{ { L"num", 1 } });
+                context.define(L"others", toWideStr("key1"), paramap{ { L"num", 1 } }); // same key, other table
+
+                // One at a time
+                int64_t rowId = context.getRowId(L"strkeys", toWideStr("key1"));
+                Assert::IsTrue(rowId >= 0);
+                Assert::IsTrue(rowId != context.getRowId(L"others", toWideStr("key1")));
+                Assert::AreEqual(std::wstring(L"key1"), context.getRowStringValue(L"strkeys", rowId).value());
+                Assert::IsTrue(!context.getRowStringValue(L"numkeys", rowId).has_value());
+                Assert::AreEqual(int64_t(-1), context.getRowId(L"strkeys", toWideStr("nope")));
+                Assert::AreEqual(int64_t(-1), context.getRowId(L"nope", toWideStr("key1")));
+                Assert::AreEqual(7.0, context.getRowNumberValue(L"numkeys", context.getRowId(L"numkeys", 7.0)).value());
+
+                // In batches, in order, with the ones not found
+                std::vector<strnum> keys;
+                for (int idx = 39; idx >= 0; --idx)
+                    keys.push_back(toWideStr("key" + std::to_string(idx)));
+                keys.push_back(toWideStr("nope"));
+                auto rowIds = context.getRowIds(L"strkeys", keys);
+                Assert::AreEqual(keys.size(), rowIds.size());
+                Assert::AreEqual(int64_t(-1), rowIds.back());
+
+                rowIds.back() = context.getRowId(L"others", toWideStr("key1"));
+                auto values = context.getRowStringValues(L"strkeys", rowIds);
+                for (size_t k = 0; k < keys.size() - 1; ++k)
+                    Assert::AreEqual(keys[k].str(), values[k].value());
+                Assert::IsTrue(!values.back().has_value()); // not in this table
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Key Lookups Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlGetRows)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_get_rows_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 50; ++idx)
+                {
+                    paramap row{ { L"num", idx }, { L"name", toWideStr("name" + std::to_string(idx)) } };
+                    if (idx % 2 == 0)
+                        row.insert({ L"even", 1 });
+                    rows.insert({ static_cast<double>(idx), row });
+                }
+                context.define(L"rows", rows, [](const wchar_t*) {});
+
+                // Few rows, asked for columns, in the order asked for
+                auto got = context.getRows(L"rows", { 3.0, 1000.0, 2.0 }, { L"name", L"nope", L"even" });
+                Assert::AreEqual(size_t(2), got.keys.size());
+                Assert::AreEqual(3.0, got.keys[0].num());
+                Assert::AreEqual(std::wstring(L"name3"), got.values[0][0]->str());
+                Assert::AreEqual(std::wstring(L"name2"), got.values[0][1]->str());
+                Assert::IsTrue(!got.values[1][0].has_value() && !got.values[1][1].has_value());
+                Assert::IsTrue(!got.values[2][0].has_value());
+                Assert::AreEqual(1.0, got.values[2][1]->num());
+
+                // Many rows, all columns
+                std::vector<strnum> keys;
+                for (int idx = 49; idx >= 0; --idx)
+                    keys.push_back(static_cast<double>(idx));
+                got = context.getRows(L"rows", keys);
+                Assert::IsTrue(std::vector<std::wstring>{ L"even", L"name", L"num" } == got.columns);
+                Assert::AreEqual(size_t(50), got.keys.size());
+                for (size_t r = 0; r < got.keys.size(); ++r)
+                {
+                    Assert::AreEqual(got.keys[r].num(), got.values[2][r]->num());
+                    Assert::AreEqual(static_cast<int>(got.keys[r].num()) % 2 == 0, got.values[0][r].has_value());
+                }
+
+                // The row's own fields, by few rows and by many
+                got = context.getRows(L"rows", { 3.0, 2.0 }, { L"value", L"id", L"created", L"lastmodified", L"num" });
+                Assert::AreEqual(size_t(2), got.keys.size());
+                for (size_t r = 0; r < got.keys.size(); ++r)
+                {
+                    Assert::AreEqual(got.keys[r].num(), got.values[0][r]->num());
+                    Assert::IsTrue(got.values[1][r]->num() > 0);
+                    Assert::IsTrue(!got.values[2][r]->str().empty());
+                    Assert::IsTrue(!got.values[3][r]->str().empty());
+                    Assert::AreEqual(got.keys[r].num(), got.values[4][r]->num());
+                }
+                Assert::IsTrue(got.values[1][0]->num() != got.values[1][1]->num());
+
+                got = context.getRows(L"rows", keys, { L"created", L"value" });
+                Assert::AreEqual(size_t(50), got.keys.size());
+                for (size_t r = 0; r < got.keys.size(); ++r)
+                {
+                    Assert::IsTrue(!got.values[0][r]->str().empty());
+                    Assert::AreEqual(got.keys[r].num(), got.values[1][r]->num());
+                }
+
+                // Other reserved names are not row fields
+                {
+                    bool threw = false;
+                    try { context.getRows(L"rows", keys, { L"num", L"count" }); }
+                    catch (const fourdberr&) { threw = true; }
+                    Assert::IsTrue(threw);
+                }
+
+                // No table, no rows
+                got = context.getRows(L"nope", keys, { L"num" });
+                Assert::AreEqual(size_t(0), got.keys.size());
+                Assert::AreEqual(size_t(1), got.values.size());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Get Rows Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlOrInBetween)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_or_in_between_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 100; ++idx)
+                    rows.insert({ static_cast<double>(idx), paramap{ { L"num", idx }, { L"name", toWideStr("name" + std::to_string(idx % 10)) } } });
+                context.define(L"ors", rows, [](const wchar_t*) {});
+
+                auto countRows = [&context](select query)
+                {
+                    int count = 0;
+                    auto reader = context.execQuery(query);
+                    while (reader->read())
+                        ++count;
+                    return count;
+                };
+
+                auto select = sql::parse(L"SELECT value FROM ors WHERE num IN (@a, @b, @c) AND name = @name");
+                select.addParam(L"@a", 3.0).addParam(L"@b", 13.0).addParam(L"@c", 14.0).addParam(L"@name", toWideStr("name3"));
+                Assert::AreEqual(2, countRows(select)); // 3, 13
+
+                select = sql::parse(L"SELECT value FROM ors WHERE num BETWEEN @lo AND @hi");
+                select.addParam(L"@lo", 10.0).addParam(L"@hi", 19.0);
+                Assert::AreEqual(10, countRows(select));
+
+                // ORs on different columns start from the rows each one seeks
+                select = sql::parse(L"SELECT value FROM ors WHERE (num < @num OR name = @name OR value = @value)");
+                select.addParam(L"@num", 5.0).addParam(L"@name", toWideStr("name9")).addParam(L"@value", 50.0);
+                Assert::IsTrue(context.generateSql(select).find(L" UNION ") != std::wstring::npos);
+                Assert::AreEqual(16, countRows(select)); // 0-4, 9, 19, ..., 99, and 50
+
+                // Lists of any length, same SQL
+                select = sql::parse(L"SELECT value FROM ors WHERE name IN @names AND (num < @lo OR num > @hi)");
+                select.addParam(L"@names", std::vector<strnum>{ toWideStr("name1"), toWideStr("name2"), toWideStr("\"quoted\"") });
+                select.addParam(L"@lo", 20.0).addParam(L"@hi", 80.0);
+                Assert::AreEqual(8, countRows(select)); // 1, 2, 11, 12, 81, 82, 91, 92
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Or In Between Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+        TEST_METHOD(TestSqlPaging)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_paging_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 95; ++idx)
+                    rows.insert({ static_cast<double>(idx), paramap{ { L"num", idx / 3 }, { L"name", toWideStr("name" + std::to_string(idx % 2)) } } });
+                context.define(L"pages", rows, [](const wchar_t*) {});
+
+                // The keys of all the rows, a page at a time
+                auto getAllKeys = [&context](const std::wstring& sql)
+                {
+                    std::vector<double> keys;
+                    auto select = sql::parse(sql);
+                    select.addParam(L"@name", toWideStr("name1"));
+                    while (true)
+                    {
+                        auto page = select;
+                        int count = 0;
+                        double lastNum = 0;
+                        int64_t lastId = 0;
+                        auto reader = context.execQuery(page);
+                        while (reader->read())
+                        {
+                            lastId = reader->getInt64(0);
+                            lastNum = reader->getDouble(1);
+                            keys.push_back(reader->getDouble(2));
+                            ++count;
+                        }
+                        if (count == 0)
+                            break;
+                        select.startAfter({ lastNum }, lastId);
+                    }
+                    return keys;
+                };
+
+                auto sql = L"SELECT id, num, value FROM pages WHERE name = @name ORDER BY num DESC LIMIT 10";
+                auto keys = getAllKeys(sql);
+                Assert::AreEqual(size_t(47), keys.size());
+                for (size_t k = 1; k < keys.size(); ++k)
+                    Assert::IsTrue(static_cast<int>(keys[k - 1]) / 3 >= static_cast<int>(keys[k]) / 3);
+                Assert::AreEqual(size_t(47), std::unordered_set<double>(keys.begin(), keys.end()).size());
+
+                // Same pages going through a column index
+                context.createIndex(L"pages", L"num");
+                Assert::IsTrue(keys == getAllKeys(sql));
+
+                // Without ORDER BY, in ID order
+                keys = getAllKeys(L"SELECT id, id, value FROM pages LIMIT 7");
+                Assert::AreEqual(size_t(95), keys.size());
+
+                // Keyset pages need the ID
+                auto select = sql::parse(L"SELECT num FROM pages ORDER BY num LIMIT 10");
+                select.startAfter({ 3.0 }, 1);
+                bool threw = false;
+                try { context.execQuery(select); }
+                catch (const fourdberr&) { threw = true; }
+                Assert::IsTrue(threw);
+
+                // OFFSET
+                select = sql::parse(L"SELECT value, num FROM pages ORDER BY num LIMIT 5 OFFSET 93");
+                int count = 0;
+                auto reader = context.execQuery(select);
+                while (reader->read())
+                    ++count;
+                Assert::AreEqual(2, count);
+
+                // Counting, the count is the one row
+                Assert::AreEqual(int64_t(95), context.execScalarInt64(sql::parse(L"SELECT count FROM pages LIMIT 1 OFFSET 0")).value());
+                reader = context.execQuery(sql::parse(L"SELECT count FROM pages LIMIT 1 OFFSET 1"));
+                Assert::IsTrue(!reader->read());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Paging Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+
+        TEST_METHOD(TestSqlAggregates)
+        {
+            try
+            {
+                const char* testDbFilePath = "sql_aggregates_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+
+                std::unordered_map<strnum, paramap> rows;
+                for (int idx = 0; idx < 60; ++idx)
+                {
+                    rows.insert
+                    (
+                        { 
+                            static_cast<double>(idx), 
+                            paramap
+                            { 
+                                { L"plays", idx }, 
+                                { L"genre", toWideStr("g" + std::to_string(idx % 3)) }, 
+                                { L"year", 2000 + idx % 5 } 
+                            } 
+                        }
+                    );
+                }
+                rows.insert({ 100.0, paramap{ { L"plays", 1000 } } }); // no genre or year
+                context.define(L"songs", rows, [](const wchar_t*) {});
+
+                // Per-genre totals, the rows without a genre in a group of their own
+                auto reader = context.execQuery(sql::parse(L"SELECT genre, SUM(plays), count FROM songs GROUP BY genre ORDER BY genre"));
+                std::vector<std::wstring> genres;
+                std::vector<double> sums, counts;
+                Assert::AreEqual(std::string("sum_plays"), toNarrowStr(reader->getColName(1)));
+                while (reader->read())
+                {
+                    genres.push_back(reader->isNull(0) ? L"null" : reader->getString(0));
+                    sums.push_back(reader->getDouble(1));
+                    counts.push_back(reader->getDouble(2));
+                }
+                Assert::AreEqual(toWideStr("null, g0, g1, g2"), join(genres, L", "));
+                Assert::IsTrue(sums == std::vector<double>{ 1000, 570, 590, 610 });
+                Assert::IsTrue(counts == std::vector<double>{ 1, 20, 20, 20 });
+
+                // The biggest group
+                auto select = sql::parse(L"SELECT genre, SUM(plays) FROM songs WHERE year >= @year GROUP BY genre ORDER BY SUM(plays) DESC LIMIT 1");
+                select.addParam(L"@year", 2000);
+                reader = context.execQuery(select);
+                Assert::IsTrue(reader->read());
+                Assert::AreEqual(std::string("g2"), toNarrowStr(reader->getString(0)));
+                Assert::AreEqual(610.0, reader->getDouble(1));
+                Assert::IsTrue(!reader->read());
+
+                // One column of the whole table
+                reader = context.execQuery(sql::parse(L"SELECT SUM(plays), MIN(plays), MAX(plays), AVG(plays), COUNT(plays) FROM songs"));
+                Assert::IsTrue(reader->read());
+                Assert::AreEqual(2770.0, reader->getDouble(0));
+                Assert::AreEqual(0.0, reader->getDouble(1));
+                Assert::AreEqual(1000.0, reader->getDouble(2));
+                Assert::AreEqual(2770.0 / 61, reader->getDouble(3));
+                Assert::AreEqual(61.0, reader->getDouble(4));
+
+                select = sql::parse(L"SELECT COUNT(DISTINCT year) FROM songs WHERE genre = @genre");
+                select.addParam(L"@genre", toWideStr("g0"));
+                Assert::AreEqual(int64_t(5), context.execScalarInt64(select).value());
+                Assert::AreEqual(int64_t(5), context.execScalarInt64(sql::parse(L"SELECT COUNT(DISTINCT year) FROM songs")).value());
+
+                // Adding up strings, and columns that aren't grouped by
+                for (auto badSql : { L"SELECT SUM(genre) FROM songs", L"SELECT genre, SUM(plays) FROM songs", L"SELECT year, count FROM songs GROUP BY genre" })
+                {
+                    bool threw = false;
+                    try { context.execQuery(sql::parse(badSql)); }
+                    catch (const fourdberr&) { threw = true; }
+                    Assert::IsTrue(threw);
+                }
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("SQL Aggregates Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
     };
 }
@@ -25,11 +25,15 @@ namespace fourdb
 
 				values::reset(context.db());
 
+				int64_t firstStringId = -1;
 				for (int run = 1; run <= 3; ++run)
 				{
 					{
 						int64_t stringId = values::getId(context.db(), toWideStr("string value"));
 						Assert::IsTrue(stringId >= 0);
+						if (run == 1)
+							firstStringId = stringId;
+						Assert::AreEqual(firstStringId, stringId);
 
 						strnum stringValue = values::getValue(context.db(), stringId);
 						Assert::IsTrue(stringValue.isStr());
@@ -45,6 +49,12 @@ namespace fourdb
 						Assert::AreEqual(99.14, numberValue.num());	
 					}
 				}
+
+				// Found the second and third time around, not added again
+				Assert::AreEqual(2, context.db().execScalarInt32(L"SELECT COUNT(*) FROM bvalues").value());
+
+				// Full-text indexing is up to the searchable columns
+				Assert::AreEqual(0, context.db().execScalarInt32(L"SELECT COUNT(*) FROM sqlite_master WHERE name LIKE 'bvaluetext%'").value());
 			}
 			catch (const std::runtime_error& exp)
 			{
@@ -52,5 +62,65 @@ namespace fourdb
 				throw;
 			}
 		}
+
+		TEST_METHOD(TestValuesBatch)
+		{
+			try
+			{
+				const char* testDbFilePath = "values_batch_unit_tests.db";
+				if (std::filesystem::exists(testDbFilePath))
+					std::filesystem::remove(testDbFilePath);
+				ctxt context(testDbFilePath, true);
+
+				values::reset(context.db());
+
+				int64_t existingStringId = values::getId(context.db(), toWideStr("existing"));
+				int64_t existingNumberId = values::getId(context.db(), 42.0);
+
+				std::vector<strnum> batch{ toWideStr("existing"), 42.0, 42.0, toWideStr("42") };
+				for (int n = 0; n < 50; ++n)
+				{
+					batch.push_back(n + 0.5);
+					batch.push_back(L"str" + std::to_wstring(n));
+				}
+
+				for (int run = 1; run <= 2; ++run)
+				{
+					auto ids = values::getIds(context.db(), batch);
+					Assert::AreEqual(size_t(103), ids.size());
+					Assert::AreEqual(existingStringId, ids[toWideStr("existing")]);
+					Assert::AreEqual(existingNumberId, ids[42.0]);
+					Assert::AreNotEqual(existingNumberId, ids[toWideStr("42")]);
+
+					for (const auto& it : ids)
+					{
+						Assert::IsTrue(it.second >= 0);
+						Assert::IsTrue(values::getValue(context.db(), it.second) == it.first);
+						Assert::AreEqual(it.second, values::getId(context.db(), it.first));
+					}
+				}
+
+				// Searchable once a column has them
+				values::addSearch(context.db(), 1, 1);
+				std::vector<int64_t> textIds;
+				for (const auto& it : values::getIds(context.db(), batch))
+					textIds.push_back(it.second);
+				values::addText(context.db(), 1, 1, textIds);
+				values::addText(context.db(), 1, 1, textIds); // no dupes
+				std::wstring textTable = values::getTextTableName(1, 1);
+				Assert::AreEqual(1, context.db().execScalarInt32(L"SELECT COUNT(*) FROM " + textTable + L" WHERE stringSearchValue MATCH 'str7'").value());
+				Assert::AreEqual(52, context.db().execScalarInt32(L"SELECT COUNT(*) FROM " + textTable).value()); // strings only
+
+				// Nothing's in the column, so it's all stale
+				Assert::AreEqual(52, values::deleteStaleText(context.db(), 1, 1, 0, 1000));
+				values::removeSearch(context.db(), 1, 1);
+				Assert::AreEqual(0, context.db().execScalarInt32(L"SELECT COUNT(*) FROM searchcolumns").value());
+			}
+			catch (const std::runtime_error& exp)
+			{
+				Logger::WriteMessage(("Values Batch Tests EXCEPTION: " + std::string(exp.what())).c_str());
+				throw;
+			}
+		}
 	};
 }
@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "ctxt.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace fourdb
+{
+    TEST_CLASS(WriteQueueTests)
+    {
+    public:
+        TEST_METHOD(TestWriteQueue)
+        {
+            try
+            {
+                const char* testDbFilePath = "writequeue_unit_tests.db";
+                if (std::filesystem::exists(testDbFilePath))
+                    std::filesystem::remove(testDbFilePath);
+                ctxt context(testDbFilePath, true);
+                context.startWriteQueue(std::chrono::milliseconds(50));
+
+                // Lots of threads, lots of little UPSERTs
+                std::vector<std::thread> threads;
+                for (int t = 0; t < 8; ++t)
+                {
+                    threads.emplace_back([&context, t]()
+                    {
+                        std::vector<std::future<void>> futures;
+                        for (int n = 0; n < 25; ++n)
+                        {
+                            paramap metadata{ { L"thread", t }, { L"num", n } };
+                            futures.push_back(context.defineAsync(L"queued", t * 100 + n, metadata));
+                        }
+                        for (auto& future : futures)
+                            future.get();
+                    });
+                }
+                for (auto& thread : threads)
+                    thread.join();
+
+                auto countSelect = sql::parse(L"SELECT count FROM queued");
+                Assert::AreEqual(int64_t(200), context.execScalarInt64(countSelect).value());
+
+                // A bad operation fails on its own, the rest of its batch goes through
+                auto badFuture = context.defineAsync(L"queued", 999.0, paramap{ { L"num", toWideStr("not a number") } });
+                auto goodFuture = context.defineAsync(L"queued", 1000.0, paramap{ { L"num", 1000 } });
+                try
+                {
+                    badFuture.get();
+                    Assert::Fail();
+                }
+                catch (const fourdberr&) {}
+                goodFuture.get();
+
+                // The columns a failed operation added are rolled back before the next one uses them
+                // The columns are added in the map's order, so the bad value has to come after a new column
+                paramap newColumns{ { L"num", toWideStr("not a number") } };
+                for (int n = 0; newColumns.size() < 2 || newColumns.begin()->first == L"num"; ++n)
+                    newColumns.insert({ toWideStr("a" + std::to_string(n)), n });
+                std::wstring newColumn = newColumns.begin()->first;
+                badFuture = context.defineAsync(L"queued", 999.0, newColumns);
+                goodFuture = context.defineAsync(L"queued", 3.0, paramap{ { newColumn, toWideStr("y") } });
+                try
+                {
+                    badFuture.get();
+                    Assert::Fail();
+                }
+                catch (const fourdberr&) {}
+                goodFuture.get();
+
+                auto newSelect = sql::parse(L"SELECT " + newColumn + L" FROM queued WHERE value = @value");
+                newSelect.addParam(L"@value", 3.0);
+                auto newReader = context.execQuery(newSelect);
+                Assert::IsTrue(newReader->read());
+                Assert::AreEqual(std::string("y"), toNarrowStr(newReader->getString(0)));
+                newReader.reset();
+
+                context.undefineAsync(L"queued", 1000.0, L"num").get();
+                context.deleteRowAsync(L"queued", 0.0).get();
+                context.stopWriteQueue();
+
+                auto numSelect = sql::parse(L"SELECT num FROM queued WHERE value = @value");
+                numSelect.addParam(L"@value", 1000.0);
+                auto reader = context.execQuery(numSelect);
+                Assert::IsTrue(reader->read());
+                Assert::IsTrue(reader->isNull(0));
+
+                Assert::AreEqual(int64_t(200), context.execScalarInt64(countSelect).value());
+            }
+            catch (const std::runtime_error& exp)
+            {
+                Logger::WriteMessage(("Write Queue Tests EXCEPTION: " + std::string(exp.what())).c_str());
+                throw;
+            }
+        }
+    };
+}